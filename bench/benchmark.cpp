@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/Image.hpp"
+#include "../src/QuadTree.hpp"
+#include "../src/RunStats.hpp"
+
+using namespace std;
+
+// Fixed grid so runs on different builds measure the same work
+namespace {
+    const char* const CORPUS[] = {"castle.jpeg", "castle_5000.jpeg", "flower.jpg", "linux.png", "haein_og.png", "small.jpg"};
+    const int MIN_BLOCK_SIZES[] = {1, 4, 16};
+
+    // Loose, medium and strict for each method (SSIM splits more as the threshold rises)
+    const double THRESHOLDS[5][3] = {
+        {2000, 500, 50},     // Variance
+        {40, 15, 5},         // MAD
+        {120, 60, 20},       // Max Difference
+        {5, 3, 1},           // Entropy
+        {0.6, 0.85, 0.95},   // SSIM
+    };
+
+    struct Settings {
+        string corpus = "test";
+        int repeat = 5;
+        int threads = 1;
+        Image::Layout layout = Image::Layout::Interleaved;
+        string jsonFile;
+        string baselineFile;
+        double tolerance = 10; // percent slower than the baseline that counts as a regression
+        double minMs = 1; // baseline medians below this are timer noise, never flagged
+        vector<string> images; // empty runs the whole corpus
+    };
+
+    struct Case {
+        string image;
+        string layout;
+        int method;
+        double threshold;
+        int minBlockSize;
+        int nodes;
+        double buildMedian, buildP95;
+        double reconstructMedian, reconstructP95;
+        double nodesPerSecond;
+        double megabytesPerSecond; // raw RGB input bytes built per second
+
+        // Layout is left out, so a planar run can be compared against an interleaved baseline
+        string key() const {
+            ostringstream out;
+            out << image << "/" << method << "/" << threshold << "/" << minBlockSize;
+            return out.str();
+        }
+    };
+
+    const char* layoutName(Image::Layout layout) {
+        return layout == Image::Layout::Planar ? "planar" : "interleaved";
+    }
+
+    double percentile(vector<double> samples, double p) {
+        sort(samples.begin(), samples.end());
+        size_t rank = static_cast<size_t>(ceil(p * samples.size()));
+        return samples[rank == 0 ? 0 : rank - 1];
+    }
+
+    Case measure(const Image& img, const string& name, int method, double threshold, int minBlockSize, const Settings& settings) {
+        vector<double> build, reconstruct;
+        int nodes = 0;
+        Image output(img.getWidth(), img.getHeight(), img.getLayout());
+        for (int run = -1; run < settings.repeat; run++) { // run -1 warms caches and the allocator, it is not recorded
+            auto start = RunTimer::Clock::now();
+            QuadTree tree(method, threshold, minBlockSize, false, settings.threads);
+            tree.compressImage(img);
+            double buildMs = RunTimer::millisecondsSince(start);
+
+            start = RunTimer::Clock::now();
+            tree.decompressImage(output);
+            double reconstructMs = RunTimer::millisecondsSince(start);
+
+            if (run >= 0) {
+                build.push_back(buildMs);
+                reconstruct.push_back(reconstructMs);
+            }
+            nodes = tree.getRoot()->countTotalNodes();
+        }
+
+        Case result{name, layoutName(img.getLayout()), method, threshold, minBlockSize, nodes,
+                    percentile(build, 0.5), percentile(build, 0.95),
+                    percentile(reconstruct, 0.5), percentile(reconstruct, 0.95), 0, 0};
+        double seconds = max(result.buildMedian, 1e-6) / 1000;
+        result.nodesPerSecond = nodes / seconds;
+        result.megabytesPerSecond = 3.0 * img.getWidth() * img.getHeight() / 1e6 / seconds;
+        return result;
+    }
+
+    string toJson(const Case& c) {
+        ostringstream out;
+        out << "{\"image\":\"" << c.image << "\",\"layout\":\"" << c.layout << "\",\"method\":" << c.method << ",\"threshold\":" << c.threshold
+            << ",\"min_block_size\":" << c.minBlockSize << ",\"nodes\":" << c.nodes
+            << ",\"build_median_ms\":" << c.buildMedian << ",\"build_p95_ms\":" << c.buildP95
+            << ",\"reconstruct_median_ms\":" << c.reconstructMedian << ",\"reconstruct_p95_ms\":" << c.reconstructP95
+            << ",\"nodes_per_sec\":" << c.nodesPerSecond << ",\"mb_per_sec\":" << c.megabytesPerSecond << "}";
+        return out.str();
+    }
+
+    // Reads back the flat one-object-per-line records toJson writes
+    map<string, string> parseFlatObject(const string& line) {
+        map<string, string> fields;
+        size_t pos = 0;
+        while ((pos = line.find('"', pos)) != string::npos) {
+            size_t keyEnd = line.find('"', pos + 1);
+            if (keyEnd == string::npos || keyEnd + 1 >= line.size() || line[keyEnd + 1] != ':') break;
+            string key = line.substr(pos + 1, keyEnd - pos - 1);
+            size_t valueStart = keyEnd + 2;
+            size_t valueEnd;
+            string value;
+            if (line[valueStart] == '"') {
+                valueEnd = line.find('"', valueStart + 1);
+                if (valueEnd == string::npos) break;
+                value = line.substr(valueStart + 1, valueEnd - valueStart - 1);
+                valueEnd++;
+            } else {
+                valueEnd = line.find_first_of(",}", valueStart);
+                if (valueEnd == string::npos) break;
+                value = line.substr(valueStart, valueEnd - valueStart);
+            }
+            fields[key] = value;
+            pos = valueEnd;
+        }
+        return fields;
+    }
+
+    map<string, Case> loadBaseline(const string& filename) {
+        ifstream in(filename);
+        if (!in) {
+            throw runtime_error("Cannot open baseline " + filename);
+        }
+        map<string, Case> cases;
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) continue;
+            map<string, string> f = parseFlatObject(line);
+            try {
+                // Records from before --layout existed were all interleaved
+                Case c{f.at("image"), f.count("layout") ? f.at("layout") : "interleaved", stoi(f.at("method")), stod(f.at("threshold")), stoi(f.at("min_block_size")),
+                       stoi(f.at("nodes")), stod(f.at("build_median_ms")), stod(f.at("build_p95_ms")),
+                       stod(f.at("reconstruct_median_ms")), stod(f.at("reconstruct_p95_ms")),
+                       stod(f.at("nodes_per_sec")), stod(f.at("mb_per_sec"))};
+                cases[c.key()] = c;
+            } catch (const exception&) {
+                throw runtime_error("Malformed baseline record: " + line);
+            }
+        }
+        return cases;
+    }
+
+    void printUsage(ostream& out) {
+        out << "Usage: benchmark [--corpus DIR] [--image NAME]... [--repeat N] [--threads N] [--layout L]\n"
+            << "                 [--json FILE] [--baseline FILE] [--tolerance PERCENT] [--min-ms MS]\n"
+            << "  --corpus DIR       directory holding the test images (default test)\n"
+            << "  --image NAME       only this corpus image, may be repeated\n"
+            << "  --repeat N         timed runs per case after one warm-up (default 5)\n"
+            << "  --threads N        build and reconstruction threads, 0 for all (default 1)\n"
+            << "  --layout L         pixel layout, interleaved or planar (default interleaved)\n"
+            << "  --json FILE        save the results, one JSON record per case\n"
+            << "  --baseline FILE    compare against results saved with --json\n"
+            << "  --tolerance P      median slowdown in percent counted as a regression (default 10)\n"
+            << "  --min-ms MS        only flag cases whose baseline build median is at least MS (default 1)\n"
+            << "Exits with 1 when a case regresses against the baseline.\n";
+    }
+
+    bool parseArgs(int argc, char* argv[], Settings& settings) {
+        for (int i = 1; i < argc; i++) {
+            string flag = argv[i];
+            if (flag == "--help" || flag == "-h" || i + 1 >= argc) return false;
+            string value = argv[++i];
+            try {
+                if (flag == "--corpus") settings.corpus = value;
+                else if (flag == "--image") settings.images.push_back(value);
+                else if (flag == "--repeat") settings.repeat = stoi(value);
+                else if (flag == "--threads") settings.threads = stoi(value);
+                else if (flag == "--layout" && (value == "interleaved" || value == "planar"))
+                    settings.layout = value == "planar" ? Image::Layout::Planar : Image::Layout::Interleaved;
+                else if (flag == "--json") settings.jsonFile = value;
+                else if (flag == "--baseline") settings.baselineFile = value;
+                else if (flag == "--tolerance") settings.tolerance = stod(value);
+                else if (flag == "--min-ms") settings.minMs = stod(value);
+                else return false;
+            } catch (const exception&) {
+                return false;
+            }
+        }
+        return settings.repeat >= 1 && settings.threads >= 0 && settings.tolerance >= 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!parseArgs(argc, argv, settings)) {
+        printUsage(cerr);
+        return 2;
+    }
+
+    try {
+        map<string, Case> baseline;
+        if (!settings.baselineFile.empty()) {
+            baseline = loadBaseline(settings.baselineFile);
+        }
+
+        vector<string> images = settings.images;
+        if (images.empty()) images.assign(begin(CORPUS), end(CORPUS));
+
+        vector<Case> results;
+        int regressions = 0;
+        cout << left << setw(18) << "image" << setw(4) << "m" << setw(9) << "thresh" << setw(5) << "blk"
+             << right << setw(10) << "nodes" << setw(11) << "build ms" << setw(10) << "p95" << setw(10) << "recon ms"
+             << setw(10) << "p95" << setw(12) << "Mnodes/s" << setw(10) << "MB/s" << setw(10) << "vs base" << "\n";
+        cout << fixed;
+
+        for (const string& name : images) {
+            string path = (filesystem::path(settings.corpus) / name).string();
+            Image img(path, settings.layout);
+            for (int method = 1; method <= 5; method++) {
+                for (double threshold : THRESHOLDS[method - 1]) {
+                    for (int minBlockSize : MIN_BLOCK_SIZES) {
+                        Case c = measure(img, name, method, threshold, minBlockSize, settings);
+                        results.push_back(c);
+
+                        cout << left << setw(18) << name << setw(4) << method << setw(9) << setprecision(2) << threshold
+                             << setw(5) << minBlockSize << right << setw(10) << c.nodes << setprecision(3)
+                             << setw(11) << c.buildMedian << setw(10) << c.buildP95
+                             << setw(10) << c.reconstructMedian << setw(10) << c.reconstructP95
+                             << setw(12) << c.nodesPerSecond / 1e6 << setw(10) << setprecision(1) << c.megabytesPerSecond;
+
+                        auto base = baseline.find(c.key());
+                        if (base != baseline.end()) {
+                            // Positive is slower than the baseline
+                            double change = (c.buildMedian / base->second.buildMedian - 1) * 100;
+                            cout << setw(9) << showpos << change << "%" << noshowpos;
+                            if (change > settings.tolerance && base->second.buildMedian >= settings.minMs) {
+                                cout << "  REGRESSION";
+                                regressions++;
+                            }
+                        }
+                        cout << endl;
+                    }
+                }
+            }
+        }
+
+        if (!settings.jsonFile.empty()) {
+            ofstream out(settings.jsonFile);
+            for (const Case& c : results) {
+                out << toJson(c) << "\n";
+            }
+            if (!out) {
+                throw runtime_error("Failed to write " + settings.jsonFile);
+            }
+        }
+
+        if (!baseline.empty()) {
+            cout << regressions << " of " << results.size() << " cases regressed more than "
+                 << setprecision(1) << settings.tolerance << "% against " << settings.baselineFile << endl;
+        }
+        return regressions == 0 ? 0 : 1;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,260 @@
+#include "BatchPipeline.hpp"
+#include "BoundedQueue.hpp"
+#include "Image.hpp"
+#include "QuadTree.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // One image on its way through the stages
+    struct Work {
+        size_t index;
+        size_t charged = 0; // bytes held in the budget until the output is written
+        unique_ptr<Image> image;
+        unique_ptr<LinearQuadTree> tree; // 8 bytes a node while it waits for an encoder
+    };
+
+    using WorkQueue = BoundedQueue<unique_ptr<Work>>;
+
+    // Bytes the images in flight may take together, 0 for no limit. An image
+    // is always admitted when nothing else is, however large it is
+    class MemoryBudget {
+    public:
+        explicit MemoryBudget(size_t limit) : limit(limit) {}
+
+        void acquire(size_t bytes) {
+            unique_lock<mutex> lock(m);
+            released.wait(lock, [&] { return limit == 0 || used == 0 || used + bytes <= limit; });
+            used += bytes;
+        }
+
+        void release(size_t bytes) {
+            {
+                lock_guard<mutex> lock(m);
+                used -= bytes;
+            }
+            released.notify_all();
+        }
+
+    private:
+        size_t limit;
+        size_t used = 0;
+        mutex m;
+        condition_variable released;
+    };
+
+    string lowercase(string text) {
+        transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        return text;
+    }
+
+    bool isSupportedImage(const fs::path& path) {
+        string ext = lowercase(path.extension().string());
+        return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp";
+    }
+
+    bool isTreeFormat(const string& path) {
+        string ext = Image::extensionOf(path);
+        return ext == "qtc" || ext == "qtt";
+    }
+
+    // Starts count threads running body; the last one to finish runs done
+    template <typename Body, typename Done>
+    void startStage(vector<thread>& threads, int count, Body body, Done done) {
+        auto remaining = make_shared<atomic<int>>(count);
+        for (int i = 0; i < count; i++) {
+            threads.emplace_back([body, done, remaining] {
+                body();
+                if (--*remaining == 0) done();
+            });
+        }
+    }
+}
+
+BatchPipeline::BatchPipeline(const BatchSettings& settings) : settings(settings) {
+    if (settings.method < 1 || settings.method > 5) {
+        throw invalid_argument("Method must be between 1 and 5");
+    }
+    if (settings.decodeWorkers < 1 || settings.compressWorkers < 1 || settings.encodeWorkers < 1) {
+        throw invalid_argument("Every stage needs at least one worker");
+    }
+}
+
+vector<RunStats> BatchPipeline::run(const vector<BatchJob>& jobs, const function<void(const RunStats&)>& finished) const {
+    // A job's record is filled by one stage at a time, the queues hand it over
+    vector<RunStats> results(jobs.size());
+    WorkQueue decoded(settings.queueCapacity);
+    WorkQueue compressed(settings.queueCapacity);
+    MemoryBudget budget(settings.memoryBudget);
+    atomic<size_t> nextJob(0);
+    vector<thread> threads;
+    mutex finishedLock;
+
+    auto finish = [&](size_t index) {
+        results[index].peakMemoryBytes = RunTimer::peakMemoryBytes();
+        if (finished) {
+            lock_guard<mutex> lock(finishedLock);
+            finished(results[index]);
+        }
+    };
+    auto fail = [&](size_t index, const exception& e) {
+        results[index].ok = false;
+        results[index].error = e.what();
+        finish(index);
+    };
+
+    startStage(threads, settings.decodeWorkers, [&] {
+        for (size_t index = nextJob++; index < jobs.size(); index = nextJob++) {
+            RunStats& stats = results[index];
+            stats.input = jobs[index].input;
+            stats.output = jobs[index].output;
+            stats.method = settings.method;
+            auto work = make_unique<Work>();
+            work->index = index;
+            try {
+                stats.inputBytes = fs::file_size(jobs[index].input);
+
+                // Charged from the header before decoding, so an image waiting for room holds no pixels.
+                // An unreadable header is left to the decoder to report
+                int width, height;
+                if (Image::readSize(jobs[index].input, width, height)) {
+                    work->charged = static_cast<size_t>(width) * height * COMPRESS_BYTES_PER_PIXEL;
+                    budget.acquire(work->charged);
+                }
+
+                RunTimer::Clock::time_point start = RunTimer::Clock::now();
+                work->image = make_unique<Image>(jobs[index].input);
+                stats.decodeMs = RunTimer::millisecondsSince(start);
+                decoded.push(move(work));
+            } catch (const exception& e) {
+                if (work) budget.release(work->charged);
+                fail(index, e);
+            }
+        }
+    }, [&decoded] { decoded.close(); });
+
+    startStage(threads, settings.compressWorkers, [&] {
+        unique_ptr<Work> work;
+        while (decoded.pop(work)) {
+            try {
+                // Each image builds serially, the stage's workers are the parallelism. A target
+                // is searched in the output's format, --format may differ from the input's
+                QuadTree tree = RunTimer::compress(*work->image, settings.method, settings.threshold,
+                                                   settings.minBlockSize, settings.targetCompression,
+                                                   Image::extensionOf(jobs[work->index].output),
+                                                   1, results[work->index]);
+                work->image.reset(); // the pixels are no longer needed, only the flat tree moves on
+                work->tree = make_unique<LinearQuadTree>(tree.toLinear());
+                tree.clear();
+
+                // Until its output is written the image only needs the flat tree and, for a
+                // raster, the painted image with its encoding
+                bool raster = !isTreeFormat(jobs[work->index].output);
+                size_t pixels = static_cast<size_t>(work->tree->getWidth()) * work->tree->getHeight();
+                size_t encodeBytes = work->tree->memoryUsage() + (raster ? pixels * ENCODE_BYTES_PER_PIXEL : 0);
+                if (encodeBytes < work->charged) {
+                    budget.release(work->charged - encodeBytes);
+                    work->charged = encodeBytes;
+                }
+                compressed.push(move(work));
+            } catch (const exception& e) {
+                budget.release(work->charged);
+                fail(work->index, e);
+            }
+        }
+    }, [&compressed] { compressed.close(); });
+
+    startStage(threads, settings.encodeWorkers, [&] {
+        unique_ptr<Work> work;
+        while (compressed.pop(work)) {
+            RunStats& stats = results[work->index];
+            try {
+                const string& output = jobs[work->index].output;
+                if (!RunTimer::save(*work->tree, output, stats)) {
+                    throw runtime_error("Failed to save " + output);
+                }
+                stats.ok = true;
+                budget.release(work->charged);
+                finish(work->index);
+            } catch (const exception& e) {
+                budget.release(work->charged);
+                fail(work->index, e);
+            }
+        }
+    }, [] {});
+
+    for (thread& t : threads) {
+        t.join();
+    }
+    return results;
+}
+
+vector<BatchJob> BatchPipeline::jobsFor(const vector<string>& inputs, const string& outputDir, const string& format) {
+    // Compared lowercased and absolute, so case-insensitive file systems and
+    // different spellings of one directory still count as the same file
+    auto key = [](const fs::path& path) { return lowercase(fs::absolute(path).lexically_normal().string()); };
+
+    set<string> taken; // inputs are never overwritten, outputs never shared
+    for (const string& input : inputs) {
+        taken.insert(key(input));
+    }
+
+    vector<BatchJob> jobs;
+    for (const string& input : inputs) {
+        fs::path source(input);
+        string sourceExtension = lowercase(source.extension().string());
+        string extension = format.empty() ? sourceExtension : "." + lowercase(format);
+        string stem = (fs::path(outputDir) / source.stem()).string();
+
+        // a.png, then a_jpg.png for the a.jpg next to it, then a_jpg_2.png, ...
+        string output = stem + extension;
+        if (taken.count(key(output))) {
+            stem += "_" + sourceExtension.substr(sourceExtension.empty() ? 0 : 1);
+            output = stem + extension;
+            for (int copy = 2; taken.count(key(output)); copy++) {
+                output = stem + "_" + to_string(copy) + extension;
+            }
+        }
+        taken.insert(key(output));
+        jobs.push_back(BatchJob{input, output});
+    }
+    return jobs;
+}
+
+vector<BatchJob> BatchPipeline::jobsFromDirectory(const string& inputDir, const string& outputDir, const string& format) {
+    vector<string> inputs;
+    for (const fs::directory_entry& entry : fs::directory_iterator(inputDir)) {
+        if (entry.is_regular_file() && isSupportedImage(entry.path())) {
+            inputs.push_back(entry.path().string());
+        }
+    }
+    sort(inputs.begin(), inputs.end());
+    return jobsFor(inputs, outputDir, format);
+}
+
+vector<BatchJob> BatchPipeline::jobsFromList(const string& listFile, const string& outputDir, const string& format) {
+    ifstream in(listFile);
+    if (!in) {
+        throw runtime_error("Cannot open " + listFile);
+    }
+
+    vector<string> inputs;
+    string line;
+    while (getline(in, line)) {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) continue;
+        inputs.push_back(line);
+    }
+    return jobsFor(inputs, outputDir, format);
+}
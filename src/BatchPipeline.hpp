@@ -0,0 +1,64 @@
+#ifndef BATCHPIPELINE_HPP
+#define BATCHPIPELINE_HPP
+
+#include "RunStats.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct BatchJob {
+    string input;
+    string output;
+};
+
+struct BatchSettings {
+    int method = 1;
+    double threshold = 0;
+    int minBlockSize = 1;
+    double targetCompression = 0; // 0 uses threshold and minBlockSize as given
+    int decodeWorkers = 1;
+    int compressWorkers = 1;
+    int encodeWorkers = 1;
+    size_t queueCapacity = 4; // images waiting between two stages
+    size_t memoryBudget = 0; // bytes the images in flight may take together, 0 for no limit
+};
+
+// Compresses many images through three stages, decode -> compress -> encode,
+// each with its own workers and a bounded queue in front of the next stage.
+// An image is charged COMPRESS_BYTES_PER_PIXEL per pixel against memoryBudget
+// before it is decoded, and waits until that fits next to the images in flight;
+// one larger than the whole budget runs alone. Once built, its charge shrinks to
+// the flat tree plus ENCODE_BYTES_PER_PIXEL for a raster output, and is given
+// back when the output is written. One failing image is reported in its stats
+// and does not stop the others.
+class BatchPipeline {
+public:
+    // Peak per pixel of one image being compressed: the pixels, the summed-area
+    // tables and a fully split tree, measured on the costliest method (SSIM)
+    static const size_t COMPRESS_BYTES_PER_PIXEL = 64;
+    // A raster output being written: the painted image and stb's in-memory encoding of it
+    static const size_t ENCODE_BYTES_PER_PIXEL = 8;
+
+    explicit BatchPipeline(const BatchSettings& settings);
+
+    // One record per job, in job order. finished, when given, is called once per
+    // record as soon as it is final, one call at a time, in completion order
+    vector<RunStats> run(const vector<BatchJob>& jobs, const function<void(const RunStats&)>& finished = nullptr) const;
+
+    // Every JPG, JPEG, PNG or BMP file directly in inputDir, sorted by name
+    static vector<BatchJob> jobsFromDirectory(const string& inputDir, const string& outputDir, const string& format);
+    // One input path per line, blank lines skipped
+    static vector<BatchJob> jobsFromList(const string& listFile, const string& outputDir, const string& format);
+
+private:
+    BatchSettings settings;
+
+    // outputDir/<input name>, with format as the extension when given. An output that
+    // would overwrite an input or another job's output gets the input's extension
+    // added to its name (a_jpg.png), then a counter
+    static vector<BatchJob> jobsFor(const vector<string>& inputs, const string& outputDir, const string& format);
+};
+
+#endif // BATCHPIPELINE_HPP
@@ -0,0 +1,235 @@
+#include "BlockKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOCK_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Integer totals of one channel split around a pivot, enough to rebuild
+    // sum |v - mean| exactly for any mean in [pivot, pivot + 1)
+    struct DeviationSums {
+        uint64_t total;
+        uint64_t above;      // sum of the values greater than the pivot
+        uint64_t countAbove; // how many values are greater than the pivot
+    };
+
+    typedef void (*DeviationRow)(const unsigned char* row, int count, int step, int pivot, DeviationSums& sums);
+    typedef void (*MinMaxRow)(const unsigned char* row, int count, int step, unsigned char& lo, unsigned char& hi);
+
+    struct Kernels {
+        const char* name;
+        DeviationRow deviation;
+        MinMaxRow minMax;
+    };
+
+    void deviationScalar(const unsigned char* row, int count, int step, int pivot, DeviationSums& sums) {
+        for (int i = 0; i < count; i++) {
+            int val = row[i * step];
+            sums.total += val;
+            if (val > pivot) {
+                sums.above += val;
+                sums.countAbove++;
+            }
+        }
+    }
+
+    void minMaxScalar(const unsigned char* row, int count, int step, unsigned char& lo, unsigned char& hi) {
+        for (int i = 0; i < count; i++) {
+            unsigned char val = row[i * step];
+            lo = min(lo, val);
+            hi = max(hi, val);
+        }
+    }
+
+#ifdef BLOCK_KERNELS_X86
+    // Each vector kernel is compiled for its own instruction set, the rest of
+    // the file keeps the baseline one; select() only picks what the CPU runs
+
+    // 16 consecutive values of one channel of an interleaved row. Reads 48
+    // bytes, so the caller keeps one more pixel in the row past the last one used.
+    __attribute__((target("sse4.1"))) inline __m128i loadInterleaved(const unsigned char* row) {
+        const __m128i first = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+        const __m128i third = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)), first);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 16)), second);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 32)), third);
+        return _mm_or_si128(_mm_or_si128(a, b), c);
+    }
+
+    __attribute__((target("sse4.1"))) inline uint64_t horizontalSum(__m128i v) {
+        alignas(16) uint64_t lanes[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+        return lanes[0] + lanes[1];
+    }
+
+    // Number of pixels the vector loop may take from a row of this step
+    inline int vectorPixels(int count, int step) {
+        return step == 1 ? count : count - 1;
+    }
+
+    __attribute__((target("sse4.1"))) void deviationSse(const unsigned char* row, int count, int step, int pivot, DeviationSums& sums) {
+        if ((step != 1 && step != 3) || pivot >= 255) {
+            deviationScalar(row, count, step, pivot, sums);
+            return;
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i bound = _mm_set1_epi8(static_cast<char>(pivot + 1));
+        __m128i total = zero, above = zero, countAbove = zero;
+
+        int i = 0;
+        for (int limit = vectorPixels(count, step); i + 16 <= limit; i += 16) {
+            __m128i v = step == 1 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) : loadInterleaved(row + i * 3);
+            __m128i isAbove = _mm_cmpeq_epi8(_mm_max_epu8(v, bound), v); // v >= pivot + 1
+            total = _mm_add_epi64(total, _mm_sad_epu8(v, zero));
+            above = _mm_add_epi64(above, _mm_sad_epu8(_mm_and_si128(v, isAbove), zero));
+            countAbove = _mm_add_epi64(countAbove, _mm_sad_epu8(_mm_and_si128(isAbove, one), zero));
+        }
+
+        sums.total += horizontalSum(total);
+        sums.above += horizontalSum(above);
+        sums.countAbove += horizontalSum(countAbove);
+        deviationScalar(row + i * step, count - i, step, pivot, sums);
+    }
+
+    __attribute__((target("sse4.1"))) void minMaxSse(const unsigned char* row, int count, int step, unsigned char& lo, unsigned char& hi) {
+        if (step != 1 && step != 3) {
+            minMaxScalar(row, count, step, lo, hi);
+            return;
+        }
+
+        __m128i vlo = _mm_set1_epi8(static_cast<char>(lo));
+        __m128i vhi = _mm_set1_epi8(static_cast<char>(hi));
+
+        int i = 0;
+        for (int limit = vectorPixels(count, step); i + 16 <= limit; i += 16) {
+            __m128i v = step == 1 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) : loadInterleaved(row + i * 3);
+            vlo = _mm_min_epu8(vlo, v);
+            vhi = _mm_max_epu8(vhi, v);
+        }
+
+        alignas(16) unsigned char lows[16], highs[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lows), vlo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(highs), vhi);
+        for (int k = 0; k < 16; k++) {
+            lo = min(lo, lows[k]);
+            hi = max(hi, highs[k]);
+        }
+        minMaxScalar(row + i * step, count - i, step, lo, hi);
+    }
+
+    // Planar rows are contiguous and take 32 values per step, interleaved
+    // rows keep the 16-wide shuffle path
+    __attribute__((target("avx2"))) void deviationAvx2(const unsigned char* row, int count, int step, int pivot, DeviationSums& sums) {
+        if (step != 1 || pivot >= 255) {
+            deviationSse(row, count, step, pivot, sums);
+            return;
+        }
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i bound = _mm256_set1_epi8(static_cast<char>(pivot + 1));
+        __m256i total = zero, above = zero, countAbove = zero;
+
+        int i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+            __m256i isAbove = _mm256_cmpeq_epi8(_mm256_max_epu8(v, bound), v);
+            total = _mm256_add_epi64(total, _mm256_sad_epu8(v, zero));
+            above = _mm256_add_epi64(above, _mm256_sad_epu8(_mm256_and_si256(v, isAbove), zero));
+            countAbove = _mm256_add_epi64(countAbove, _mm256_sad_epu8(_mm256_and_si256(isAbove, one), zero));
+        }
+
+        alignas(32) uint64_t lanes[3][4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[0]), total);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[1]), above);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes[2]), countAbove);
+        for (int k = 0; k < 4; k++) {
+            sums.total += lanes[0][k];
+            sums.above += lanes[1][k];
+            sums.countAbove += lanes[2][k];
+        }
+        deviationSse(row + i, count - i, step, pivot, sums);
+    }
+
+    __attribute__((target("avx2"))) void minMaxAvx2(const unsigned char* row, int count, int step, unsigned char& lo, unsigned char& hi) {
+        if (step != 1) {
+            minMaxSse(row, count, step, lo, hi);
+            return;
+        }
+
+        __m256i vlo = _mm256_set1_epi8(static_cast<char>(lo));
+        __m256i vhi = _mm256_set1_epi8(static_cast<char>(hi));
+
+        int i = 0;
+        for (; i + 32 <= count; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+            vlo = _mm256_min_epu8(vlo, v);
+            vhi = _mm256_max_epu8(vhi, v);
+        }
+
+        alignas(32) unsigned char lows[32], highs[32];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lows), vlo);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(highs), vhi);
+        for (int k = 0; k < 32; k++) {
+            lo = min(lo, lows[k]);
+            hi = max(hi, highs[k]);
+        }
+        minMaxSse(row + i, count - i, step, lo, hi);
+    }
+
+#endif
+
+    Kernels select() {
+#ifdef BLOCK_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernels{"avx2", deviationAvx2, minMaxAvx2};
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return Kernels{"sse4.1", deviationSse, minMaxSse};
+        }
+#endif
+        return Kernels{"scalar", deviationScalar, minMaxScalar};
+    }
+
+    const Kernels& active() {
+        static const Kernels kernels = select();
+        return kernels;
+    }
+}
+
+double BlockKernels::absDeviation(const Image::BlockView<const unsigned char>& block, int channel, double mean) {
+    if (block.empty()) return 0.0;
+
+    // Values at or below floor(mean) contribute mean - v, the rest v - mean,
+    // so three integer sums give the whole deviation
+    int pivot = static_cast<int>(floor(mean));
+    DeviationSums sums{0, 0, 0};
+    DeviationRow kernel = active().deviation;
+    for (int dy = 0; dy < block.height; dy++) {
+        kernel(block.row(channel, dy), block.width, block.step, pivot, sums);
+    }
+
+    double count = static_cast<double>(block.width) * block.height;
+    double below = static_cast<double>(sums.total - sums.above);
+    double belowCount = count - static_cast<double>(sums.countAbove);
+    return (static_cast<double>(sums.above) - sums.countAbove * mean) + (belowCount * mean - below);
+}
+
+void BlockKernels::minMax(const Image::BlockView<const unsigned char>& block, int channel, unsigned char& minOut, unsigned char& maxOut) {
+    MinMaxRow kernel = active().minMax;
+    for (int dy = 0; dy < block.height; dy++) {
+        kernel(block.row(channel, dy), block.width, block.step, minOut, maxOut);
+    }
+}
+
+const char* BlockKernels::implementation() {
+    return active().name;
+}
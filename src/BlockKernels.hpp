@@ -0,0 +1,19 @@
+#ifndef BLOCKKERNELS_HPP
+#define BLOCKKERNELS_HPP
+
+#include "Image.hpp"
+
+// Per-channel reductions over a block of 8-bit pixels. Each call walks the
+// block row by row with the best kernel the CPU supports (AVX2, SSE4.1 or
+// plain scalar), picked once at first use.
+namespace BlockKernels {
+    // Sum of |value - mean| over one channel of the block
+    double absDeviation(const Image::BlockView<const unsigned char>& block, int channel, double mean);
+
+    // Smallest and largest value of one channel, folded into minOut/maxOut
+    void minMax(const Image::BlockView<const unsigned char>& block, int channel, unsigned char& minOut, unsigned char& maxOut);
+
+    const char* implementation(); // "avx2", "sse4.1" or "scalar"
+}
+
+#endif // BLOCKKERNELS_HPP
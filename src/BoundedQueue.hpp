@@ -0,0 +1,56 @@
+#ifndef BOUNDEDQUEUE_HPP
+#define BOUNDEDQUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+using namespace std;
+
+// Blocking FIFO between pipeline stages. push waits while the queue is full,
+// which keeps a fast producer from buffering unbounded work ahead of a slow
+// consumer; pop waits while it is empty and fails once it is closed and drained.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity < 1 ? 1 : capacity), closed(false) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    void push(T item) {
+        unique_lock<mutex> guard(lock);
+        notFull.wait(guard, [this] { return items.size() < capacity || closed; });
+        if (closed) return; // consumers are gone, the item is dropped
+        items.push_back(move(item));
+        notEmpty.notify_one();
+    }
+
+    bool pop(T& item) {
+        unique_lock<mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+        item = move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    // No more pushes: waiting consumers drain what is left, then pop returns false
+    void close() {
+        lock_guard<mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    mutex lock;
+    condition_variable notFull;
+    condition_variable notEmpty;
+    deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+#endif // BOUNDEDQUEUE_HPP
@@ -0,0 +1,176 @@
+#include "EntropyPyramid.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    typedef EntropyPyramid::Histogram Histogram;
+
+    const int DENSE_PIXELS = 256; // past this a sparse list is no smaller than the dense bins
+
+    // Sort values and collapse equal runs into (value, count) bins
+    void compact(vector<pair<int, int>>& bins) {
+        sort(bins.begin(), bins.end());
+        size_t out = 0;
+        for (size_t i = 0; i < bins.size(); i++) {
+            if (out > 0 && bins[out - 1].first == bins[i].first) {
+                bins[out - 1].second += bins[i].second;
+            } else {
+                bins[out++] = bins[i];
+            }
+        }
+        bins.resize(out);
+    }
+
+    Histogram scanBlock(const Image& img, int x, int y, int width, int height) {
+        Histogram h;
+        Image::BlockView<const unsigned char> block = img.view(x, y, width, height);
+        h.pixelCount = block.empty() ? 0 : block.width * block.height;
+
+        if (h.pixelCount > DENSE_PIXELS) {
+            h.dense = true;
+            for (int c = 0; c < 3; c++) {
+                h.counts[c].assign(256, 0);
+                int* counts = h.counts[c].data();
+                for (int dy = 0; dy < block.height; dy++) {
+                    const unsigned char* row = block.row(c, dy);
+                    for (int i = 0; i < block.width; i++) {
+                        counts[row[i * block.step]]++;
+                    }
+                }
+            }
+            return h;
+        }
+
+        // Sorting at most DENSE_PIXELS values on the stack beats clearing 256 bins
+        unsigned char values[3][DENSE_PIXELS];
+        int n = h.pixelCount;
+        for (int c = 0; c < 3; c++) {
+            unsigned char* out = values[c];
+            for (int dy = 0; dy < block.height; dy++) {
+                const unsigned char* row = block.row(c, dy);
+                for (int i = 0; i < block.width; i++) {
+                    *out++ = row[i * block.step];
+                }
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            sort(values[c], values[c] + n);
+            for (int i = 0; i < n; i++) {
+                if (!h.bins[c].empty() && h.bins[c].back().first == values[c][i]) {
+                    h.bins[c].back().second++;
+                } else {
+                    h.bins[c].push_back(make_pair(static_cast<int>(values[c][i]), 1));
+                }
+            }
+        }
+        return h;
+    }
+
+    void merge(Histogram* parts, Histogram& out) {
+        out = Histogram();
+        for (int k = 0; k < 4; k++) out.pixelCount += parts[k].pixelCount;
+
+        if (out.pixelCount > DENSE_PIXELS) {
+            out.dense = true;
+            for (int c = 0; c < 3; c++) out.counts[c].assign(256, 0);
+            for (int k = 0; k < 4; k++) {
+                for (int c = 0; c < 3; c++) {
+                    if (parts[k].dense) {
+                        for (int v = 0; v < 256; v++) out.counts[c][v] += parts[k].counts[c][v];
+                    } else {
+                        for (const pair<int, int>& bin : parts[k].bins[c]) out.counts[c][bin.first] += bin.second;
+                    }
+                }
+            }
+            return;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            for (int k = 0; k < 4; k++) {
+                out.bins[c].insert(out.bins[c].end(), parts[k].bins[c].begin(), parts[k].bins[c].end());
+            }
+            compact(out.bins[c]);
+        }
+    }
+
+    // -p log2(p) for one bin. Small counts repeat a lot within a block, so
+    // their terms are remembered instead of calling log2 again.
+    struct TermCache {
+        static const int SIZE = 16;
+        int pixelCount;
+        double terms[SIZE];
+        bool known[SIZE];
+
+        explicit TermCache(int pixelCount) : pixelCount(pixelCount), known{} {}
+
+        double term(int count) {
+            if (count < SIZE && known[count]) return terms[count];
+            double p = static_cast<double>(count) / pixelCount;
+            double value = p * log2(p);
+            if (count < SIZE) {
+                terms[count] = value;
+                known[count] = true;
+            }
+            return value;
+        }
+    };
+
+    // Same summation order as a 0..255 sweep, so results match a direct histogram exactly
+    double entropyOf(const Histogram& h) {
+        if (h.pixelCount == 0) return 0.0;
+
+        TermCache cache(h.pixelCount);
+        double entropy[3] = {0};
+        for (int c = 0; c < 3; c++) {
+            if (h.dense) {
+                for (int val = 0; val < 256; val++) {
+                    if (h.counts[c][val] > 0) {
+                        entropy[c] -= cache.term(h.counts[c][val]);
+                    }
+                }
+            } else {
+                for (const pair<int, int>& bin : h.bins[c]) {
+                    entropy[c] -= cache.term(bin.second);
+                }
+            }
+        }
+        return (entropy[0] + entropy[1] + entropy[2]) / 3.0;
+    }
+}
+
+EntropyPyramid::EntropyPyramid(const Image& img, int minCellSize)
+    : grid(img.getWidth(), img.getHeight(), minCellSize), entropies(grid.getLevels()) {
+    for (int d = 0; d < grid.getLevels(); d++) {
+        entropies[d].resize(static_cast<size_t>(1) << (2 * d));
+    }
+
+    // Depth-first, so at most four histograms per level are alive at a time
+    Histogram root;
+    build(img, 0, 0, 0, root);
+}
+
+void EntropyPyramid::build(const Image& img, int level, int row, int column, Histogram& out) {
+    if (level == grid.getFinestLevel()) {
+        out = scanBlock(img, grid.cellX(level, column), grid.cellY(level, row),
+                        grid.cellWidth(level, column), grid.cellHeight(level, row));
+    } else {
+        Histogram parts[4];
+        for (int k = 0; k < 4; k++) {
+            build(img, level + 1, 2 * row + k / 2, 2 * column + k % 2, parts[k]);
+        }
+        merge(parts, out);
+    }
+    entropies[level][(static_cast<size_t>(row) << level) + column] = entropyOf(out);
+}
+
+bool EntropyPyramid::entropy(int level, int x, int y, int width, int height, double& out) const {
+    long long index = grid.cellIndex(level, x, y, width, height);
+    if (index < 0) return false;
+
+    out = entropies[level][index];
+    return true;
+}
+
+double EntropyPyramid::blockEntropy(const Image& img, int x, int y, int width, int height) {
+    return entropyOf(scanBlock(img, x, y, width, height));
+}
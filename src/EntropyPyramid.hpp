@@ -0,0 +1,37 @@
+#ifndef ENTROPYPYRAMID_HPP
+#define ENTROPYPYRAMID_HPP
+
+#include "Image.hpp"
+#include "QuadGrid.hpp"
+
+// Entropy of every cell of a QuadGrid. Histograms are built once for the
+// finest cells and each parent histogram is the merge of its four children,
+// so no pixel is read more than once. Small blocks keep sparse sorted
+// (value, count) lists and switch to dense 256-bin arrays once they grow.
+// Only the entropies are kept; histograms live just long enough to be merged.
+class EntropyPyramid {
+public:
+    explicit EntropyPyramid(const Image& img, int minCellSize = 4);
+
+    // False when the block is not a cell of the pyramid (too deep or misaligned)
+    bool entropy(int level, int x, int y, int width, int height, double& out) const;
+    int getLevels() const { return grid.getLevels(); }
+
+    // Direct computation for blocks the pyramid does not cover
+    static double blockEntropy(const Image& img, int x, int y, int width, int height);
+
+    struct Histogram {
+        int pixelCount = 0;
+        bool dense = false;
+        vector<pair<int, int>> bins[3]; // sparse: (value, count) in ascending value order
+        vector<int> counts[3];          // dense: 256 counts per channel
+    };
+
+private:
+    QuadGrid grid;
+    vector<vector<double>> entropies; // entropies[d][row * 2^d + column]
+
+    void build(const Image& img, int level, int row, int column, Histogram& out);
+};
+
+#endif // ENTROPYPYRAMID_HPP
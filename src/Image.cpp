@@ -4,8 +4,16 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "include/stb_image_write.h"
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
-Image::Image(const string& filename) {
+namespace {
+    void countBytes(void* context, void* /*data*/, int size) {
+        *static_cast<size_t*>(context) += size;
+    }
+}
+
+Image::Image(const string& filename, Layout layout) : layout(Layout::Interleaved) {
     int channels;
    
     FILE* testFile = fopen(filename.c_str(), "rb");
@@ -15,20 +23,61 @@ Image::Image(const string& filename) {
         fclose(testFile);
     }
     unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 3);
+    if (!data) {
+        throw runtime_error("Failed to decode image: " + filename);
+    }
 
     try {
-        pixels.resize(width * height * 3);
-        copy(data, data + width * height * 3, pixels.begin());
+        pixels.resize(static_cast<size_t>(width) * height * 3);
+        copy(data, data + static_cast<size_t>(width) * height * 3, pixels.begin());
     } catch (...) {
         stbi_image_free(data);
         throw;
     }
     
     stbi_image_free(data);
+    convertTo(layout);
+}
+
+bool Image::readSize(const string& filename, int& width, int& height) {
+    int channels;
+    return stbi_info(filename.c_str(), &width, &height, &channels) != 0;
 }
 
-Image::Image(int width, int height) : width(width), height(height) {
-    pixels.resize(width * height * 3, 0); // Initialize to black
+Image::Image(int width, int height, Layout layout) : width(width), height(height), layout(layout) {
+    pixels.resize(static_cast<size_t>(width) * height * 3, 0); // Initialize to black
+}
+
+void Image::convertTo(Layout target) {
+    if (target == layout) return;
+
+    size_t planeSize = static_cast<size_t>(width) * height;
+    vector<unsigned char> converted(pixels.size());
+    for (size_t i = 0; i < planeSize; i++) {
+        for (int c = 0; c < 3; c++) {
+            if (target == Layout::Planar) {
+                converted[c * planeSize + i] = pixels[i * 3 + c];
+            } else {
+                converted[i * 3 + c] = pixels[c * planeSize + i];
+            }
+        }
+    }
+    pixels.swap(converted);
+    layout = target;
+}
+
+const unsigned char* Image::interleavedData(vector<unsigned char>& scratch) const {
+    // The stb writers only take interleaved rows
+    if (layout == Layout::Interleaved) return pixels.data();
+
+    size_t planeSize = static_cast<size_t>(width) * height;
+    scratch.resize(pixels.size());
+    for (size_t i = 0; i < planeSize; i++) {
+        for (int c = 0; c < 3; c++) {
+            scratch[i * 3 + c] = pixels[c * planeSize + i];
+        }
+    }
+    return scratch.data();
 }
 
 Image::~Image() {
@@ -37,15 +86,17 @@ Image::~Image() {
 
 bool Image::save(const string& filename) const {
     try {
-        string ext = filename.substr(filename.find_last_of(".") + 1);
+        string ext = extensionOf(filename);
         int success = 0;
+        vector<unsigned char> scratch;
+        const unsigned char* data = interleavedData(scratch);
         
         if (ext == "png") {
-            success = stbi_write_png(filename.c_str(), width, height, 3, pixels.data(), width * 3);
+            success = stbi_write_png(filename.c_str(), width, height, 3, data, width * 3);
         } else if (ext == "jpg" || ext == "jpeg") {
-            success = stbi_write_jpg(filename.c_str(), width, height, 3, pixels.data(), 90);
+            success = stbi_write_jpg(filename.c_str(), width, height, 3, data, 90);
         } else if (ext == "bmp") {
-            success = stbi_write_bmp(filename.c_str(), width, height, 3, pixels.data());
+            success = stbi_write_bmp(filename.c_str(), width, height, 3, data);
         } else {
             throw runtime_error("Please check your path and extension.");
         }
@@ -57,17 +108,89 @@ bool Image::save(const string& filename) const {
     }
 }
 
-int Image::getPixel(int x, int y, int channel) const {
-    if (x < 0 || x >= width || y < 0 || y >= height || channel < 0 || channel > 2) {
-        throw out_of_range("Pixel coordinates or channel out of range");
+string Image::extensionOf(const string& filename) {
+    return filename.substr(filename.find_last_of(".") + 1);
+}
+
+size_t Image::encodedSize(const string& extension) const {
+    size_t bytes = 0;
+    int success = 0;
+    vector<unsigned char> scratch;
+    const unsigned char* data = interleavedData(scratch);
+
+    // Same encoders and settings as save(), but the output only feeds a byte counter
+    if (extension == "png") {
+        success = stbi_write_png_to_func(countBytes, &bytes, width, height, 3, data, width * 3);
+    } else if (extension == "jpg" || extension == "jpeg") {
+        success = stbi_write_jpg_to_func(countBytes, &bytes, width, height, 3, data, 90);
+    } else if (extension == "bmp") {
+        success = stbi_write_bmp_to_func(countBytes, &bytes, width, height, 3, data);
+    } else {
+        throw runtime_error("Please check your path and extension.");
+    }
+
+    return success != 0 ? bytes : 0;
+}
+
+Image::BlockView<const unsigned char> Image::view(int x, int y, int w, int h) const {
+    // Clip once here so callers can walk the rows unchecked
+    int x2 = min(x + w, width);
+    int y2 = min(y + h, height);
+    x = max(x, 0);
+    y = max(y, 0);
+
+    BlockView<const unsigned char> block{{nullptr, nullptr, nullptr}, 0, pixelStep(), max(0, x2 - x), max(0, y2 - y)};
+    if (block.empty()) return block;
+
+    block.rowStride = layout == Layout::Interleaved ? static_cast<size_t>(width) * 3 : width;
+    for (int c = 0; c < 3; c++) {
+        block.origin[c] = channelRow(c, y) + static_cast<size_t>(x) * block.step;
     }
-    return pixels[(y * width + x) * 3 + channel];
+    return block;
+}
+
+Image::BlockView<unsigned char> Image::view(int x, int y, int w, int h) {
+    BlockView<const unsigned char> block = static_cast<const Image&>(*this).view(x, y, w, h);
+    return BlockView<unsigned char>{
+        {const_cast<unsigned char*>(block.origin[0]), const_cast<unsigned char*>(block.origin[1]), const_cast<unsigned char*>(block.origin[2])},
+        block.rowStride, block.step, block.width, block.height};
 }
 
-void Image::setPixel(int x, int y, int channel, int value) {
-    if (x < 0 || x >= width || y < 0 || y >= height || channel < 0 || channel > 2) {
-        throw out_of_range("Pixel coordinates or channel out of range");
+void Image::fillRect(int x, int y, int w, int h, const unsigned char color[3]) {
+    BlockView<unsigned char> block = view(x, y, w, h);
+    if (block.empty()) return;
+
+    if (layout == Layout::Planar) {
+        for (int c = 0; c < 3; c++) {
+            for (int dy = 0; dy < block.height; dy++) {
+                memset(block.row(c, dy), color[c], block.width);
+            }
+        }
+        return;
+    }
+
+    if (block.width <= 4) { // leaves near pixel level: a memcpy call costs more than the stores
+        for (int dy = 0; dy < block.height; dy++) {
+            unsigned char* row = block.row(0, dy);
+            for (int i = 0; i < block.width * 3; i += 3) {
+                row[i] = color[0];
+                row[i + 1] = color[1];
+                row[i + 2] = color[2];
+            }
+        }
+        return;
     }
-    value = max(0, min(255, value));  // limit it to 0-255 range
-    pixels[(y * width + x) * 3 + channel] = static_cast<unsigned char>(value);
-}
\ No newline at end of file
+
+    // Build the first RGB row by doubling copies of one pixel, then copy that row down
+    unsigned char* first = block.row(0, 0);
+    const size_t rowBytes = static_cast<size_t>(block.width) * 3;
+    first[0] = color[0];
+    first[1] = color[1];
+    first[2] = color[2];
+    for (size_t filled = 3; filled < rowBytes; filled *= 2) {
+        memcpy(first + filled, first, min(filled, rowBytes - filled));
+    }
+    for (int dy = 1; dy < block.height; dy++) {
+        memcpy(block.row(0, dy), first, rowBytes);
+    }
+}
@@ -8,19 +8,81 @@ using namespace std;
 
 class Image {
 public:
-    Image(const string& filename);
-    Image(int width, int height);  
+    // Interleaved keeps RGBRGB... rows, Planar keeps three contiguous channel planes
+    enum class Layout { Interleaved, Planar };
+
+    Image(const string& filename, Layout layout = Layout::Interleaved);
+    Image(int width, int height, Layout layout = Layout::Interleaved);  
     ~Image();
 
     bool save(const string& filename) const;
-    int getPixel(int x, int y, int channel) const;
-    void setPixel(int x, int y, int channel, int value);
+    size_t encodedSize(const string& extension) const; // bytes the encoder would write, without touching disk
+    static string extensionOf(const string& filename);
+    static bool readSize(const string& filename, int& width, int& height); // from the header only, false if unreadable
+    inline int getPixel(int x, int y, int channel) const;
+    inline void setPixel(int x, int y, int channel, int value);
     int getWidth() const { return width; }
     int getHeight() const { return height; }
 
+    Layout getLayout() const { return layout; }
+    void convertTo(Layout target);
+
+    // Unchecked access for hot loops: channel values of row y start at
+    // channelRow(c, y) and are pixelStep() bytes apart (3 interleaved, 1 planar)
+    const unsigned char* channelRow(int channel, int y) const {
+        return layout == Layout::Interleaved ? &pixels[static_cast<size_t>(y) * width * 3 + channel]
+                                             : &pixels[(static_cast<size_t>(channel) * height + y) * width];
+    }
+    unsigned char* channelRow(int channel, int y) {
+        return const_cast<unsigned char*>(static_cast<const Image&>(*this).channelRow(channel, y));
+    }
+    int pixelStep() const { return layout == Layout::Interleaved ? 3 : 1; }
+
+    // A rectangle clipped to the image once; rows inside it are then read
+    // without further checks. row(c, dy)[i * step] is channel c of pixel
+    // (x + i, y + dy).
+    template <typename T>
+    struct BlockView {
+        T* origin[3];
+        size_t rowStride;
+        int step;
+        int width, height;
+
+        T* row(int channel, int dy) const { return origin[channel] + dy * rowStride; }
+        bool empty() const { return width <= 0 || height <= 0; }
+    };
+
+    BlockView<const unsigned char> view(int x, int y, int width, int height) const;
+    BlockView<unsigned char> view(int x, int y, int width, int height);
+
+    // Paint a rectangle (clipped to the image) with one color, row copies instead of per-pixel writes
+    void fillRect(int x, int y, int width, int height, const unsigned char color[3]);
+
 private:
     int width, height;
+    Layout layout;
     vector<unsigned char> pixels;
+
+    size_t indexOf(int x, int y, int channel) const {
+        return layout == Layout::Interleaved ? (static_cast<size_t>(y) * width + x) * 3 + channel
+                                             : (static_cast<size_t>(channel) * height + y) * width + x;
+    }
+    const unsigned char* interleavedData(vector<unsigned char>& scratch) const;
 };
 
+inline int Image::getPixel(int x, int y, int channel) const {
+    if (x < 0 || x >= width || y < 0 || y >= height || channel < 0 || channel > 2) {
+        throw out_of_range("Pixel coordinates or channel out of range");
+    }
+    return pixels[indexOf(x, y, channel)];
+}
+
+inline void Image::setPixel(int x, int y, int channel, int value) {
+    if (x < 0 || x >= width || y < 0 || y >= height || channel < 0 || channel > 2) {
+        throw out_of_range("Pixel coordinates or channel out of range");
+    }
+    value = value < 0 ? 0 : (value > 255 ? 255 : value);  // limit it to 0-255 range
+    pixels[indexOf(x, y, channel)] = static_cast<unsigned char>(value);
+}
+
 #endif // IMAGE_HPP
\ No newline at end of file
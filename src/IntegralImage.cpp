@@ -0,0 +1,186 @@
+#include "IntegralImage.hpp"
+#include <algorithm>
+
+IntegralImage::IntegralImage(const Image& img, int planes)
+    : width(img.getWidth()), height(img.getHeight()) {
+    sums.build(img, 3, 255, [](const unsigned char* p[3], uint64_t out[]) {
+        out[0] = p[0][0];
+        out[1] = p[1][0];
+        out[2] = p[2][0];
+    });
+    if (planes & SQUARES) {
+        squares.build(img, 1, 3 * 255 * 255, [](const unsigned char* p[3], uint64_t out[]) {
+            out[0] = p[0][0] * p[0][0] + p[1][0] * p[1][0] + p[2][0] * p[2][0];
+        });
+    }
+    if (planes & LUMINANCE) {
+        luminance.build(img, 2, 255000ULL * 255000ULL, [](const unsigned char* p[3], uint64_t out[]) {
+            uint64_t lum = 299 * p[0][0] + 587 * p[1][0] + 114 * p[2][0];
+            out[0] = lum;
+            out[1] = lum * lum;
+        });
+    }
+}
+
+int IntegralImage::planesForMethod(int method) {
+    switch (method) {
+        case 1: return SQUARES;   // Variance
+        case 5: return LUMINANCE; // SSIM
+        default: return SUMS;     // MAD, Max Difference and Entropy only take block means
+    }
+}
+
+template <typename Value>
+void IntegralImage::SumTable::build(const Image& img, int components, uint64_t maxPixelValue, Value value) {
+    this->components = components;
+    uint64_t pixels = static_cast<uint64_t>(img.getWidth()) * img.getHeight();
+    if (maxPixelValue * pixels < (1ULL << 32)) {
+        fill(narrow, img, value);
+    } else {
+        fill(wide, img, value);
+    }
+}
+
+template <typename T, typename Value>
+void IntegralImage::SumTable::fill(vector<T>& cells, const Image& img, Value value) {
+    const int width = img.getWidth();
+    const int height = img.getHeight();
+    const size_t stride = static_cast<size_t>(width + 1) * components;
+    cells.assign(stride * (height + 1), 0);
+    Image::BlockView<const unsigned char> pixels = img.view(0, 0, width, height);
+
+    uint64_t rowTotals[3];
+    uint64_t pixelValues[3];
+    for (int y = 0; y < height; y++) {
+        const unsigned char* rows[3] = {pixels.row(0, y), pixels.row(1, y), pixels.row(2, y)};
+        fill_n(rowTotals, components, 0);
+        const T* above = &cells[y * stride];
+        T* current = &cells[(y + 1) * stride];
+
+        for (int x = 0; x < width; x++) {
+            const size_t offset = static_cast<size_t>(x) * pixels.step;
+            const unsigned char* pixel[3] = {rows[0] + offset, rows[1] + offset, rows[2] + offset};
+            value(pixel, pixelValues);
+            const size_t cell = static_cast<size_t>(x + 1) * components;
+            for (int c = 0; c < components; c++) {
+                rowTotals[c] += pixelValues[c];
+                current[cell + c] = static_cast<T>(above[cell + c] + rowTotals[c]); // narrow cells wrap on purpose
+            }
+        }
+    }
+}
+
+void IntegralImage::SumTable::blockTotals(const size_t corners[4], uint64_t out[]) const {
+    if (empty()) {
+        throw logic_error("Summed-area table was not built for this error method");
+    }
+    for (int c = 0; c < components; c++) {
+        if (!narrow.empty()) {
+            uint32_t total = narrow[corners[3] * components + c] - narrow[corners[1] * components + c] -
+                             narrow[corners[2] * components + c] + narrow[corners[0] * components + c];
+            out[c] = total;
+        } else {
+            out[c] = wide[corners[3] * components + c] - wide[corners[1] * components + c] -
+                     wide[corners[2] * components + c] + wide[corners[0] * components + c];
+        }
+    }
+}
+
+bool IntegralImage::corners(int x, int y, int w, int h, size_t out[4]) const {
+    int x2 = min(x + w, width);
+    int y2 = min(y + h, height);
+    x = max(x, 0);
+    y = max(y, 0);
+    if (x2 <= x || y2 <= y) return false;
+
+    const size_t stride = width + 1;
+    out[0] = y * stride + x;
+    out[1] = y * stride + x2;
+    out[2] = y2 * stride + x;
+    out[3] = y2 * stride + x2;
+    return true;
+}
+
+uint64_t IntegralImage::sum(int channel, int x, int y, int w, int h) const {
+    if (channel < 0 || channel > 2) {
+        throw out_of_range("Channel out of range");
+    }
+    size_t cell[4];
+    uint64_t totals[3] = {0, 0, 0};
+    if (corners(x, y, w, h, cell)) sums.blockTotals(cell, totals);
+    return totals[channel];
+}
+
+uint64_t IntegralImage::sumSquares(int x, int y, int w, int h) const {
+    size_t cell[4];
+    uint64_t total = 0;
+    if (corners(x, y, w, h, cell)) squares.blockTotals(cell, &total);
+    return total;
+}
+
+int IntegralImage::pixelCount(int x, int y, int w, int h) const {
+    int x2 = min(x + w, width);
+    int y2 = min(y + h, height);
+    x = max(x, 0);
+    y = max(y, 0);
+    return (x2 > x && y2 > y) ? (x2 - x) * (y2 - y) : 0;
+}
+
+double IntegralImage::variance(int x, int y, int w, int h) const {
+    size_t cell[4];
+    if (!corners(x, y, w, h, cell)) return 0.0;
+    int pixelCount = this->pixelCount(x, y, w, h);
+
+    uint64_t totals[3];
+    uint64_t squareTotal;
+    sums.blockTotals(cell, totals);
+    squares.blockTotals(cell, &squareTotal);
+
+    // sum of squared deviations over the channels = sum(p^2) - sum over channels of sum(p) * mean
+    double deviations = static_cast<double>(squareTotal);
+    for (int k = 0; k < 3; k++) {
+        deviations -= static_cast<double>(totals[k]) * totals[k] / pixelCount;
+    }
+    return max(0.0, deviations) / (3.0 * pixelCount);
+}
+
+void IntegralImage::mean(int x, int y, int w, int h, double out[3]) const {
+    size_t cell[4];
+    uint64_t totals[3] = {0, 0, 0};
+    int pixelCount = corners(x, y, w, h, cell) ? this->pixelCount(x, y, w, h) : 0;
+    if (pixelCount > 0) sums.blockTotals(cell, totals);
+    for (int k = 0; k < 3; k++) {
+        out[k] = pixelCount > 0 ? static_cast<double>(totals[k]) / pixelCount : 0.0;
+    }
+}
+
+void IntegralImage::averageColor(int x, int y, int w, int h, int out[3]) const {
+    size_t cell[4];
+    uint64_t totals[3] = {0, 0, 0};
+    int pixelCount = corners(x, y, w, h, cell) ? this->pixelCount(x, y, w, h) : 0;
+    if (pixelCount > 0) sums.blockTotals(cell, totals);
+    for (int k = 0; k < 3; k++) {
+        out[k] = pixelCount > 0 ? static_cast<int>(totals[k] / pixelCount) : 0;
+    }
+}
+
+double IntegralImage::luminanceMean(int x, int y, int w, int h) const {
+    size_t cell[4];
+    if (!corners(x, y, w, h, cell)) return 0.0;
+
+    uint64_t totals[2];
+    luminance.blockTotals(cell, totals);
+    return static_cast<double>(totals[0]) / pixelCount(x, y, w, h) / 1000.0;
+}
+
+double IntegralImage::luminanceVariance(int x, int y, int w, int h) const {
+    size_t cell[4];
+    if (!corners(x, y, w, h, cell)) return 0.0;
+    int pixelCount = this->pixelCount(x, y, w, h);
+
+    uint64_t totals[2];
+    luminance.blockTotals(cell, totals);
+    double mean = static_cast<double>(totals[0]) / pixelCount;
+    double squaredDeviations = max(0.0, static_cast<double>(totals[1]) - static_cast<double>(totals[0]) * mean);
+    return squaredDeviations / pixelCount / 1e6;
+}
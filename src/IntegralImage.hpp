@@ -0,0 +1,65 @@
+#ifndef INTEGRALIMAGE_HPP
+#define INTEGRALIMAGE_HPP
+
+#include "Image.hpp"
+#include <cstdint>
+
+// Summed-area tables of an image, so the statistics of any block can be
+// read with four lookups. The per-channel sums are always built; the sum of
+// squares (Variance) and the luminance sums (SSIM) only when asked for.
+class IntegralImage {
+public:
+    enum Planes {
+        SUMS = 0,
+        SQUARES = 1,
+        LUMINANCE = 2,
+        ALL = SQUARES | LUMINANCE
+    };
+
+    IntegralImage(const Image& img, int planes = ALL);
+    static int planesForMethod(int method); // only what that error method reads
+
+    uint64_t sum(int channel, int x, int y, int width, int height) const;
+    uint64_t sumSquares(int x, int y, int width, int height) const; // over all three channels, needs SQUARES
+    int pixelCount(int x, int y, int width, int height) const;
+
+    double variance(int x, int y, int width, int height) const; // needs SQUARES
+    void mean(int x, int y, int width, int height, double out[3]) const;
+    void averageColor(int x, int y, int width, int height, int out[3]) const;
+
+    // Luminance is 0.299 R + 0.587 G + 0.114 B, stored scaled by 1000 to stay integral. Needs LUMINANCE
+    double luminanceMean(int x, int y, int width, int height) const;
+    double luminanceVariance(int x, int y, int width, int height) const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+private:
+    // One (width + 1) x (height + 1) table of `components` running totals per
+    // cell. When no total over the whole image can reach 2^32 the cells are
+    // kept in 32 bits: they wrap, but block differences come out exact.
+    class SumTable {
+    public:
+        template <typename Value>
+        void build(const Image& img, int components, uint64_t maxPixelValue, Value value);
+        void blockTotals(const size_t corners[4], uint64_t out[]) const; // corners: top left, top right, bottom left, bottom right
+        bool empty() const { return components == 0; }
+
+    private:
+        int components = 0;
+        vector<uint32_t> narrow;
+        vector<uint64_t> wide;
+
+        template <typename T, typename Value>
+        void fill(vector<T>& cells, const Image& img, Value value);
+    };
+
+    int width, height;
+    SumTable sums;      // R, G, B
+    SumTable squares;   // R^2 + G^2 + B^2
+    SumTable luminance; // luminance and its square
+
+    bool corners(int x, int y, int width, int height, size_t out[4]) const; // false for an empty block
+};
+
+#endif // INTEGRALIMAGE_HPP
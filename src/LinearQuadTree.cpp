@@ -0,0 +1,96 @@
+#include "LinearQuadTree.hpp"
+#include "QtcFormat.hpp"
+#include <algorithm>
+
+LinearQuadTree::LinearQuadTree(const QuadTreeNode* root, int width, int height, int method)
+    : width(width), height(height), method(method) {
+    if (!root) return;
+
+    // Breadth-first walk: the nodes vector doubles as the queue
+    vector<const QuadTreeNode*> order;
+    order.push_back(root);
+    nodes.push_back(Node{0, {0, 0, 0}});
+
+    for (size_t i = 0; i < order.size(); i++) {
+        const QuadTreeNode* node = order[i];
+        const int* color = node->getAvgColor();
+        for (int c = 0; c < 3; c++) {
+            nodes[i].color[c] = static_cast<unsigned char>(max(0, min(255, color[c])));
+        }
+
+        if (!node->isLeafNode() && node->getChild(0)) {
+            nodes[i].firstChild = static_cast<uint32_t>(nodes.size());
+            for (int k = 0; k < 4; k++) {
+                order.push_back(node->getChild(k));
+                nodes.push_back(Node{0, {0, 0, 0}});
+            }
+        }
+    }
+}
+
+LinearQuadTree::Block LinearQuadTree::child(const Block& parent, int k) const {
+    // The same split as NodeArena::allocateChildren, odd sizes give the extra pixel to the right and bottom
+    int halfWidth = parent.width / 2;
+    int halfHeight = parent.height / 2;
+    bool right = (k & 1) != 0, bottom = (k & 2) != 0;
+    return Block{nodes[parent.index].firstChild + static_cast<uint32_t>(k),
+                 parent.x + (right ? halfWidth : 0), parent.y + (bottom ? halfHeight : 0),
+                 right ? parent.width - halfWidth : halfWidth, bottom ? parent.height - halfHeight : halfHeight,
+                 parent.level + 1};
+}
+
+int LinearQuadTree::countLeafNodes() const {
+    int count = 0;
+    for (const Node& node : nodes) {
+        if (node.firstChild == 0) count++;
+    }
+    return count;
+}
+
+int LinearQuadTree::depth() const {
+    if (nodes.empty()) return 0;
+
+    // Each level is a contiguous range, the next one starts where it ends
+    size_t levelStart = 0, levelEnd = 1;
+    int levels = 0;
+    while (true) {
+        size_t nextEnd = levelEnd;
+        for (size_t i = levelStart; i < levelEnd; i++) {
+            if (nodes[i].firstChild != 0) nextEnd += 4;
+        }
+        if (nextEnd == levelEnd) break;
+        levelStart = levelEnd;
+        levelEnd = nextEnd;
+        levels++;
+    }
+    return levels;
+}
+
+void LinearQuadTree::fillImage(Image& img) const {
+    if (nodes.empty()) return;
+
+    vector<Block> stack;
+    stack.push_back(root());
+
+    while (!stack.empty()) {
+        Block block = stack.back();
+        stack.pop_back();
+
+        if (isLeaf(block)) {
+            img.fillRect(block.x, block.y, block.width, block.height, color(block));
+            continue;
+        }
+        for (int k = 0; k < 4; k++) {
+            stack.push_back(child(block, k));
+        }
+    }
+}
+
+bool LinearQuadTree::write(ostream& out) const {
+    return QtcFormat::write(out, *this, QtcFormat::Header{width, height, method});
+}
+
+bool LinearQuadTree::writeTiled(ostream& out, int tileDepth) const {
+    if (tileDepth < 0) tileDepth = QtcFormat::defaultTileDepth(width, height);
+    return QtcFormat::writeTiled(out, *this, QtcFormat::Header{width, height, method}, tileDepth);
+}
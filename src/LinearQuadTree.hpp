@@ -0,0 +1,54 @@
+#ifndef LINEARQUADTREE_HPP
+#define LINEARQUADTREE_HPP
+
+#include "Image.hpp"
+#include "QuadTreeNode.hpp"
+#include <cstdint>
+#include <iosfwd>
+
+// Pointer-free quadtree: nodes live in one array in breadth-first order,
+// the four children of a node are contiguous and found by index, and block
+// geometry is derived from the image size while traversing. At 8 bytes a
+// node it is what a built tree is kept as while it only waits to be painted
+// or encoded; its breadth-first order is the order .qtc codes the nodes in.
+class LinearQuadTree {
+public:
+    LinearQuadTree(const QuadTreeNode* root, int width, int height, int method = 0);
+
+    // A node with the geometry the layout leaves implicit
+    struct Block {
+        uint32_t index;
+        int x, y, width, height;
+        int level;
+    };
+    Block root() const { return Block{0, 0, 0, width, height, 0}; }
+    Block child(const Block& parent, int k) const; // k: 0 top left, 1 top right, 2 bottom left, 3 bottom right
+    bool isLeaf(const Block& block) const { return nodes[block.index].firstChild == 0; }
+    const unsigned char* color(const Block& block) const { return nodes[block.index].color; }
+
+    void fillImage(Image& img) const;
+    int countTotalNodes() const { return static_cast<int>(nodes.size()); }
+    int countLeafNodes() const;
+    int depth() const;
+
+    // Native .qtc/.qtt encodings, see QtcFormat.hpp
+    bool write(ostream& out) const;
+    bool writeTiled(ostream& out, int tileDepth = -1) const; // -1 picks QtcFormat::defaultTileDepth
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getMethod() const { return method; }
+    size_t memoryUsage() const { return nodes.size() * sizeof(Node); }
+
+private:
+    struct Node {
+        uint32_t firstChild; // index of the first of four children, 0 for leaves
+        unsigned char color[3];
+    };
+
+    int width, height;
+    int method; // the error method the tree was built with, kept for the .qtc header
+    vector<Node> nodes;
+};
+
+#endif // LINEARQUADTREE_HPP
@@ -0,0 +1,54 @@
+#include "MinMaxPyramid.hpp"
+#include "BlockKernels.hpp"
+#include <algorithm>
+
+MinMaxPyramid::MinMaxPyramid(const Image& img, int minCellSize)
+    : grid(img.getWidth(), img.getHeight(), minCellSize), cells(grid.getLevels()) {
+    // Finest level straight from the pixels, each pixel is read once
+    int finest = grid.getFinestLevel();
+    int side = 1 << finest;
+    cells[finest].resize(static_cast<size_t>(side) * side);
+    for (int row = 0; row < side; row++) {
+        for (int col = 0; col < side; col++) {
+            Range r{{255, 255, 255}, {0, 0, 0}};
+            Image::BlockView<const unsigned char> block = img.view(grid.cellX(finest, col), grid.cellY(finest, row),
+                                                                   grid.cellWidth(finest, col), grid.cellHeight(finest, row));
+            for (int c = 0; c < 3; c++) {
+                BlockKernels::minMax(block, c, r.min[c], r.max[c]);
+            }
+            cells[finest][row * side + col] = r;
+        }
+    }
+
+    // Coarser levels merge their four children bottom-up
+    for (int d = finest - 1; d >= 0; d--) {
+        int n = 1 << d;
+        const vector<Range>& below = cells[d + 1];
+        cells[d].resize(static_cast<size_t>(n) * n);
+        for (int row = 0; row < n; row++) {
+            for (int col = 0; col < n; col++) {
+                Range r{{255, 255, 255}, {0, 0, 0}};
+                for (int k = 0; k < 4; k++) {
+                    const Range& child = below[(2 * row + k / 2) * (2 * n) + 2 * col + k % 2];
+                    for (int c = 0; c < 3; c++) {
+                        r.min[c] = min(r.min[c], child.min[c]);
+                        r.max[c] = max(r.max[c], child.max[c]);
+                    }
+                }
+                cells[d][row * n + col] = r;
+            }
+        }
+    }
+}
+
+bool MinMaxPyramid::range(int level, int x, int y, int width, int height, int minOut[3], int maxOut[3]) const {
+    long long index = grid.cellIndex(level, x, y, width, height);
+    if (index < 0) return false;
+
+    const Range& r = cells[level][index];
+    for (int c = 0; c < 3; c++) {
+        minOut[c] = r.min[c];
+        maxOut[c] = r.max[c];
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef MINMAXPYRAMID_HPP
+#define MINMAXPYRAMID_HPP
+
+#include "Image.hpp"
+#include "QuadGrid.hpp"
+
+// Per-channel min/max of every cell of a QuadGrid. The finest level is
+// scanned from pixels and every coarser level is merged from its four
+// children; blocks finer than that are left to a direct scan.
+class MinMaxPyramid {
+public:
+    explicit MinMaxPyramid(const Image& img, int minCellSize = 4);
+
+    // False when the block is not a cell of the pyramid (too deep or misaligned)
+    bool range(int level, int x, int y, int width, int height, int minOut[3], int maxOut[3]) const;
+    int getLevels() const { return grid.getLevels(); }
+
+private:
+    struct Range {
+        unsigned char min[3];
+        unsigned char max[3];
+    };
+
+    QuadGrid grid;
+    vector<vector<Range>> cells; // cells[d][row * 2^d + column]
+};
+
+#endif // MINMAXPYRAMID_HPP
@@ -0,0 +1,41 @@
+#include "NodeArena.hpp"
+
+NodeArena::NodeArena(size_t nodesPerChunk)
+    : chunkCapacity(nodesPerChunk < 4 ? 4 : nodesPerChunk), nodeCount(0) {
+}
+
+vector<QuadTreeNode>& NodeArena::chunkWithRoom(size_t count) {
+    // Chunks never grow past their reserved capacity, so node addresses stay valid
+    if (chunks.empty() || chunks.back().size() + count > chunkCapacity) {
+        chunks.emplace_back();
+        chunks.back().reserve(chunkCapacity);
+    }
+    nodeCount += count;
+    return chunks.back();
+}
+
+QuadTreeNode* NodeArena::allocate(int x, int y, int width, int height) {
+    vector<QuadTreeNode>& chunk = chunkWithRoom(1);
+    chunk.emplace_back(x, y, width, height);
+    return &chunk.back();
+}
+
+QuadTreeNode* NodeArena::allocateChildren(int x, int y, int width, int height, int level) {
+    int halfWidth = width / 2;
+    int halfHeight = height / 2;
+    int remainingWidth = width - halfWidth;
+    int remainingHeight = height - halfHeight;
+
+    vector<QuadTreeNode>& chunk = chunkWithRoom(4);
+    QuadTreeNode* first = chunk.data() + chunk.size();
+    chunk.emplace_back(x, y, halfWidth, halfHeight, level);
+    chunk.emplace_back(x + halfWidth, y, remainingWidth, halfHeight, level);
+    chunk.emplace_back(x, y + halfHeight, halfWidth, remainingHeight, level);
+    chunk.emplace_back(x + halfWidth, y + halfHeight, remainingWidth, remainingHeight, level);
+    return first;
+}
+
+void NodeArena::clear() {
+    chunks.clear();
+    nodeCount = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef NODEARENA_HPP
+#define NODEARENA_HPP
+
+#include "QuadTreeNode.hpp"
+#include <vector>
+#include <cstddef>
+
+// Pool for QuadTreeNode storage. Children are handed out in contiguous
+// blocks of four and the whole tree is released at once by clear() or
+// when the arena is destroyed.
+class NodeArena {
+public:
+    explicit NodeArena(size_t nodesPerChunk = 4096);
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+    NodeArena(NodeArena&&) noexcept = default;
+    NodeArena& operator=(NodeArena&&) noexcept = default;
+
+    QuadTreeNode* allocate(int x, int y, int width, int height);
+    QuadTreeNode* allocateChildren(int x, int y, int width, int height, int level);
+    void clear();
+    size_t size() const { return nodeCount; }
+
+private:
+    vector<vector<QuadTreeNode>> chunks;
+    size_t chunkCapacity;
+    size_t nodeCount;
+
+    vector<QuadTreeNode>& chunkWithRoom(size_t count);
+};
+
+#endif // NODEARENA_HPP
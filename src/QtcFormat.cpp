@@ -0,0 +1,498 @@
+#include "QtcFormat.hpp"
+#include "RangeCoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+namespace {
+    const char MAGIC[4] = {'Q', 'T', 'C', '3'};
+    const char TILED_MAGIC[4] = {'Q', 'T', 'T', '1'};
+
+    void writeU32(ostream& out, uint32_t value) {
+        unsigned char bytes[4] = {
+            static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8),
+            static_cast<unsigned char>(value >> 16), static_cast<unsigned char>(value >> 24)
+        };
+        out.write(reinterpret_cast<const char*>(bytes), 4);
+    }
+
+    uint32_t readU32(istream& in) {
+        unsigned char bytes[4];
+        if (!in.read(reinterpret_cast<char*>(bytes), 4)) {
+            throw runtime_error("Unexpected end of .qtc data");
+        }
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    // Same rule the builder applies: a split must leave every child more than one pixel
+    bool canSplit(int width, int height) {
+        return static_cast<long long>(width / 2) * (height / 2) > 1;
+    }
+
+    const int DEPTH_CONTEXTS = 16; // deeper nodes share the last context
+
+    // Adaptive statistics shared by the encoder and decoder, both start from the same state
+    struct Models {
+        BitModel split[DEPTH_CONTEXTS];
+        ByteModel color[DEPTH_CONTEXTS][2][3]; // [depth][leaf][channel]
+
+        static int depthContext(int level) { return min(level, DEPTH_CONTEXTS - 1); }
+    };
+
+    // Deltas wrap modulo 256 and are zigzag mapped so small changes of either sign get small symbols
+    int deltaSymbol(int value, int predicted) {
+        int delta = static_cast<signed char>(static_cast<unsigned char>(value - predicted));
+        return (delta >= 0) ? delta * 2 : -delta * 2 - 1;
+    }
+
+    int fromDeltaSymbol(int symbol, int predicted) {
+        int delta = (symbol & 1) ? -(symbol + 1) / 2 : symbol / 2;
+        return (predicted + delta) & 0xFF;
+    }
+
+    int clampColor(int value) {
+        return max(0, min(255, value));
+    }
+
+    // Channels move together: green and blue follow red's change from its prediction
+    int channelPrediction(const int predicted[3], const int color[3], int channel) {
+        if (channel == 0) return predicted[0];
+        return clampColor(predicted[channel] + color[0] - predicted[0]);
+    }
+
+    // The encoder walks a LinearQuadTree, the decoder rebuilds QuadTreeNodes; the
+    // predictions read both through the overloads below, so they always agree
+    struct FlatNode {
+        const LinearQuadTree* tree;
+        LinearQuadTree::Block block;
+    };
+
+    double areaOf(const QuadTreeNode& node) { return static_cast<double>(node.getWidth()) * node.getHeight(); }
+    double areaOf(const FlatNode& node) { return static_cast<double>(node.block.width) * node.block.height; }
+    int colorOf(const QuadTreeNode& node, int c) { return clampColor(node.getAvgColor()[c]); }
+    int colorOf(const FlatNode& node, int c) { return node.tree->color(node.block)[c]; }
+    const QuadTreeNode& childOf(const QuadTreeNode& node, int k) { return *node.getChild(k); }
+    FlatNode childOf(const FlatNode& node, int k) { return FlatNode{node.tree, node.tree->child(node.block, k)}; }
+
+    // The parent's average is the area weighted mean of its children, so once
+    // three children are known the fourth is predicted almost exactly. Averages
+    // are floored, each one stands for a total about half a pixel above it.
+    template <typename Node>
+    void predictLastChild(const Node& parent, const int parentColor[3], int predicted[3]) {
+        double total[3];
+        for (int c = 0; c < 3; c++) {
+            total[c] = areaOf(parent) * (parentColor[c] + 0.5);
+        }
+        for (int i = 0; i < 3; i++) {
+            const auto& child = childOf(parent, i);
+            for (int c = 0; c < 3; c++) {
+                total[c] -= areaOf(child) * (colorOf(child, c) + 0.5);
+            }
+        }
+        double lastArea = areaOf(childOf(parent, 3));
+        for (int c = 0; c < 3; c++) {
+            predicted[c] = clampColor(static_cast<int>(floor(total[c] / lastArea)));
+        }
+    }
+
+    // Prediction for child index of parent, a null parent marks the root
+    template <typename Node>
+    void predictColor(const Node* parent, int index, int predicted[3]) {
+        if (!parent) {
+            predicted[0] = predicted[1] = predicted[2] = 128;
+            return;
+        }
+        int parentColor[3];
+        for (int c = 0; c < 3; c++) {
+            parentColor[c] = colorOf(*parent, c);
+            predicted[c] = parentColor[c];
+        }
+        if (index == 3) predictLastChild(*parent, parentColor, predicted);
+    }
+
+    // Codes one node's split flag and color, returns whether it has children
+    bool encodeNode(const FlatNode& node, const int predicted[3], Models& models, RangeEncoder& rc) {
+        const LinearQuadTree::Block& block = node.block;
+        bool leaf = node.tree->isLeaf(block);
+        int depth = Models::depthContext(block.level);
+        if (canSplit(block.width, block.height)) {
+            models.split[depth].encode(rc, !leaf);
+        } else if (!leaf) {
+            throw logic_error("Tree splits a block the .qtc format treats as indivisible");
+        }
+
+        int color[3];
+        for (int c = 0; c < 3; c++) {
+            color[c] = colorOf(node, c);
+            models.color[depth][leaf][c].encode(rc, deltaSymbol(color[c], channelPrediction(predicted, color, c)));
+        }
+        return !leaf;
+    }
+
+    // Inverse of encodeNode, returns the decoded split flag
+    bool decodeNode(QuadTreeNode* node, const int predicted[3], Models& models, RangeDecoder& rc) {
+        int depth = Models::depthContext(node->getLevel());
+        bool leaf = !canSplit(node->getWidth(), node->getHeight()) || !models.split[depth].decode(rc);
+
+        int color[3];
+        for (int c = 0; c < 3; c++) {
+            color[c] = fromDeltaSymbol(models.color[depth][leaf][c].decode(rc), channelPrediction(predicted, color, c));
+        }
+        node->setAvgColor(color);
+        node->setLeaf(leaf);
+        return !leaf;
+    }
+
+    // Codes one breadth-first level whose i-th node is child i % 4 of parents[i / 4]
+    // (no parents for the root), returns the nodes that split
+    vector<FlatNode> encodeLevel(const vector<FlatNode>& level, const vector<FlatNode>& parents,
+                                 Models& models, RangeEncoder& rc) {
+        vector<FlatNode> splitNodes;
+        for (size_t i = 0; i < level.size(); i++) {
+            int predicted[3];
+            predictColor(parents.empty() ? nullptr : &parents[i / 4], static_cast<int>(i % 4), predicted);
+            if (encodeNode(level[i], predicted, models, rc)) {
+                splitNodes.push_back(level[i]);
+            }
+        }
+        return splitNodes;
+    }
+
+    // Inverse of encodeLevel. The nodes that split are returned without children yet
+    vector<QuadTreeNode*> decodeLevel(const vector<QuadTreeNode*>& level, const vector<QuadTreeNode*>& parents,
+                                      Models& models, RangeDecoder& rc, uint32_t& nodesLeft) {
+        if (level.size() > nodesLeft) {
+            throw runtime_error("Corrupt .qtc data: more nodes than the header declares");
+        }
+        nodesLeft -= static_cast<uint32_t>(level.size());
+
+        vector<QuadTreeNode*> splitNodes;
+        for (size_t i = 0; i < level.size(); i++) {
+            int predicted[3];
+            predictColor(parents.empty() ? nullptr : parents[i / 4], static_cast<int>(i % 4), predicted);
+            if (decodeNode(level[i], predicted, models, rc)) {
+                splitNodes.push_back(level[i]);
+            }
+        }
+        return splitNodes;
+    }
+
+    vector<QuadTreeNode*> childrenOf(const vector<QuadTreeNode*>& parents) {
+        vector<QuadTreeNode*> children;
+        children.reserve(parents.size() * 4);
+        for (QuadTreeNode* node : parents) {
+            for (int i = 0; i < 4; i++) children.push_back(node->getChild(i));
+        }
+        return children;
+    }
+
+    vector<FlatNode> childrenOf(const vector<FlatNode>& parents) {
+        vector<FlatNode> children;
+        children.reserve(parents.size() * 4);
+        for (const FlatNode& node : parents) {
+            for (int i = 0; i < 4; i++) children.push_back(childOf(node, i));
+        }
+        return children;
+    }
+
+    vector<QuadTreeNode*> splitAll(const vector<QuadTreeNode*>& parents, NodeArena& arena) {
+        for (QuadTreeNode* node : parents) node->split(arena);
+        return childrenOf(parents);
+    }
+
+    const size_t READ_CHUNK = 1 << 20;
+
+    // Lengths come from the stream, so the buffer only grows as data actually
+    // arrives: a corrupt length fails at the end of the stream, not in the allocator
+    void readBytes(istream& in, vector<unsigned char>& bytes, uint32_t count) {
+        bytes.clear();
+        while (bytes.size() < count) {
+            size_t done = bytes.size();
+            bytes.resize(done + min<size_t>(count - done, READ_CHUNK));
+            if (!in.read(reinterpret_cast<char*>(bytes.data() + done), bytes.size() - done)) {
+                throw runtime_error("Unexpected end of .qtc data");
+            }
+        }
+    }
+
+    void checkHeader(const QtcFormat::Header& header, int method, uint32_t nodeCount) {
+        // A tree over n pixels has fewer than 4n / 3 + 1 nodes
+        if (header.width <= 0 || header.height <= 0 || method < 1 || method > 5 || nodeCount == 0 ||
+            nodeCount > static_cast<uint64_t>(header.width) * header.height / 3 * 4 + 4) {
+            throw runtime_error("Invalid .qtc header");
+        }
+    }
+
+    bool intersects(const QuadTreeNode* node, const QtcFormat::Region& region) {
+        return node->getX() < region.x + region.width && region.x < node->getX() + node->getWidth() &&
+               node->getY() < region.y + region.height && region.y < node->getY() + node->getHeight();
+    }
+
+    const uint32_t MAX_LEVELS = 64; // node levels are stored in a byte, real trees stay far below this
+    const int TILE_PIXELS = 256; // default tiles are the first level no wider or taller than this
+}
+
+bool QtcFormat::write(ostream& out, const LinearQuadTree& tree, const Header& header) {
+    if (tree.countTotalNodes() == 0) return false;
+
+    vector<unsigned char> payload;
+    vector<uint32_t> levelBytes;
+    unique_ptr<Models> models = make_unique<Models>();
+    uint32_t nodeCount = 0;
+
+    vector<FlatNode> level = {FlatNode{&tree, tree.root()}};
+    vector<FlatNode> parents;
+    while (!level.empty()) {
+        size_t start = payload.size();
+        RangeEncoder rc(payload);
+        vector<FlatNode> splitNodes = encodeLevel(level, parents, *models, rc);
+        rc.finish(); // each level is its own segment so a reader can stop after it
+        levelBytes.push_back(static_cast<uint32_t>(payload.size() - start));
+        nodeCount += static_cast<uint32_t>(level.size());
+
+        level = childrenOf(splitNodes);
+        parents.swap(splitNodes);
+    }
+
+    out.write(MAGIC, 4);
+    writeU32(out, static_cast<uint32_t>(header.width));
+    writeU32(out, static_cast<uint32_t>(header.height));
+    out.put(static_cast<char>(header.method));
+    writeU32(out, nodeCount);
+    writeU32(out, static_cast<uint32_t>(levelBytes.size()));
+    for (uint32_t bytes : levelBytes) {
+        writeU32(out, bytes);
+    }
+    out.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    return static_cast<bool>(out);
+}
+
+QuadTreeNode* QtcFormat::read(istream& in, NodeArena& arena, Header& header, int maxDepth) {
+    char magic[4];
+    if (!in.read(magic, 4) || !equal(magic, magic + 4, MAGIC)) {
+        throw runtime_error("Not a .qtc stream");
+    }
+
+    header.width = static_cast<int>(readU32(in));
+    header.height = static_cast<int>(readU32(in));
+    int method = in.get();
+    uint32_t nodeCount = readU32(in);
+    uint32_t levelCount = readU32(in);
+    checkHeader(header, method, nodeCount);
+    if (levelCount == 0 || levelCount > MAX_LEVELS) {
+        throw runtime_error("Invalid .qtc header");
+    }
+    header.method = method;
+
+    vector<uint32_t> levelBytes(levelCount);
+    for (uint32_t& bytes : levelBytes) {
+        bytes = readU32(in);
+    }
+    uint32_t levelsToRead = (maxDepth < 0) ? levelCount : min(levelCount, static_cast<uint32_t>(maxDepth) + 1);
+
+    unique_ptr<Models> models = make_unique<Models>();
+    QuadTreeNode* root = arena.allocate(0, 0, header.width, header.height);
+    vector<QuadTreeNode*> level = {root};
+    vector<QuadTreeNode*> parents;
+    vector<unsigned char> segment;
+    uint32_t nodesLeft = nodeCount;
+    for (uint32_t depth = 0; depth < levelsToRead; depth++) {
+        readBytes(in, segment, levelBytes[depth]);
+        RangeDecoder rc(segment.data(), segment.size());
+        vector<QuadTreeNode*> splitNodes = decodeLevel(level, parents, *models, rc, nodesLeft);
+
+        if (depth + 1 == levelsToRead) {
+            if (depth + 1 == levelCount && !splitNodes.empty()) {
+                throw runtime_error("Corrupt .qtc data: the deepest level still splits");
+            }
+            for (QuadTreeNode* node : splitNodes) {
+                node->setLeaf(true); // a preview stops here, the node's average stands in for its subtree
+            }
+            break; // nothing deeper is read, so these leaves get no children
+        } else if (splitNodes.empty()) {
+            throw runtime_error("Corrupt .qtc data: fewer levels than the header declares");
+        }
+
+        level = splitAll(splitNodes, arena);
+        parents.swap(splitNodes);
+    }
+
+    if (levelsToRead == levelCount) {
+        if (nodesLeft != 0) {
+            throw runtime_error("Corrupt .qtc data: fewer nodes than the header declares");
+        }
+    } else {
+        // Leave the stream after the tree, as a full read would
+        streamoff rest = 0;
+        for (uint32_t depth = levelsToRead; depth < levelCount; depth++) rest += levelBytes[depth];
+        if (!in.seekg(rest, ios::cur)) {
+            throw runtime_error("Unexpected end of .qtc data");
+        }
+    }
+    return root;
+}
+
+int QtcFormat::defaultTileDepth(int width, int height) {
+    int depth = 0;
+    while (max(width, height) > TILE_PIXELS) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        depth++;
+    }
+    return depth;
+}
+
+bool QtcFormat::writeTiled(ostream& out, const LinearQuadTree& tree, const Header& header, int tileDepth) {
+    if (tree.countTotalNodes() == 0) return false;
+    tileDepth = max(0, min(tileDepth, static_cast<int>(MAX_LEVELS) - 1));
+
+    // Levels 0..tileDepth form the top segment
+    unique_ptr<Models> models = make_unique<Models>();
+    vector<unsigned char> top;
+    RangeEncoder topCoder(top);
+    uint32_t nodeCount = 0;
+    vector<FlatNode> level = {FlatNode{&tree, tree.root()}};
+    vector<FlatNode> parents;
+    vector<FlatNode> splitNodes;
+    for (int depth = 0; depth <= tileDepth && !level.empty(); depth++) {
+        splitNodes = encodeLevel(level, parents, *models, topCoder);
+        nodeCount += static_cast<uint32_t>(level.size());
+        if (depth < tileDepth) {
+            level = childrenOf(splitNodes);
+            parents.swap(splitNodes);
+        }
+    }
+    topCoder.finish();
+
+    // Every node at tileDepth is a tile, coded on its own from the models the top left behind.
+    // A tree that stops above tileDepth has no tiles.
+    const vector<FlatNode>& tiles = level;
+    vector<unsigned char> tileData;
+    vector<uint32_t> offsets = {0};
+    for (const FlatNode& tile : tiles) {
+        if (!tree.isLeaf(tile.block)) {
+            Models tileModels = *models;
+            RangeEncoder rc(tileData);
+            vector<FlatNode> tileParents = {tile};
+            vector<FlatNode> tileLevel = childrenOf(tileParents);
+            while (!tileLevel.empty()) {
+                vector<FlatNode> tileSplits = encodeLevel(tileLevel, tileParents, tileModels, rc);
+                nodeCount += static_cast<uint32_t>(tileLevel.size());
+                tileLevel = childrenOf(tileSplits);
+                tileParents.swap(tileSplits);
+            }
+            rc.finish();
+        }
+        offsets.push_back(static_cast<uint32_t>(tileData.size()));
+    }
+
+    out.write(TILED_MAGIC, 4);
+    writeU32(out, static_cast<uint32_t>(header.width));
+    writeU32(out, static_cast<uint32_t>(header.height));
+    out.put(static_cast<char>(header.method));
+    writeU32(out, nodeCount);
+    out.put(static_cast<char>(tileDepth));
+    writeU32(out, static_cast<uint32_t>(top.size()));
+    writeU32(out, static_cast<uint32_t>(tiles.size()));
+    for (uint32_t offset : offsets) {
+        writeU32(out, offset);
+    }
+    out.write(reinterpret_cast<const char*>(top.data()), top.size());
+    out.write(reinterpret_cast<const char*>(tileData.data()), tileData.size());
+    return static_cast<bool>(out);
+}
+
+QuadTreeNode* QtcFormat::readRegion(istream& in, NodeArena& arena, Header& header, const Region& region) {
+    char magic[4];
+    if (!in.read(magic, 4) || !equal(magic, magic + 4, TILED_MAGIC)) {
+        throw runtime_error("Not a tiled .qtc stream");
+    }
+
+    header.width = static_cast<int>(readU32(in));
+    header.height = static_cast<int>(readU32(in));
+    int method = in.get();
+    uint32_t nodeCount = readU32(in);
+    int tileDepth = in.get();
+    uint32_t topBytes = readU32(in);
+    uint32_t tileCount = readU32(in);
+    checkHeader(header, method, nodeCount);
+    if (tileDepth == char_traits<char>::eof() || tileDepth >= static_cast<int>(MAX_LEVELS) || tileCount > nodeCount) {
+        throw runtime_error("Invalid .qtc header");
+    }
+    header.method = method;
+
+    // Grown entry by entry for the same reason as readBytes
+    vector<uint32_t> offsets;
+    offsets.reserve(min<size_t>(static_cast<size_t>(tileCount) + 1, READ_CHUNK / sizeof(uint32_t)));
+    for (uint64_t i = 0; i <= tileCount; i++) {
+        offsets.push_back(readU32(in));
+    }
+    if (offsets[0] != 0 || !is_sorted(offsets.begin(), offsets.end())) {
+        throw runtime_error("Invalid .qtc tile index");
+    }
+
+    vector<unsigned char> segment;
+    readBytes(in, segment, topBytes);
+    streampos tileStart = in.tellg();
+
+    unique_ptr<Models> models = make_unique<Models>();
+    RangeDecoder topDecoder(segment.data(), segment.size());
+    QuadTreeNode* root = arena.allocate(0, 0, header.width, header.height);
+    uint32_t nodesLeft = nodeCount;
+    vector<QuadTreeNode*> level = {root};
+    vector<QuadTreeNode*> parents;
+    vector<QuadTreeNode*> splitNodes;
+    int depth = 0;
+    for (; depth <= tileDepth && !level.empty(); depth++) {
+        splitNodes = decodeLevel(level, parents, *models, topDecoder, nodesLeft);
+        if (depth < tileDepth) {
+            level = splitAll(splitNodes, arena);
+            parents.swap(splitNodes);
+        }
+    }
+    bool reachedTiles = (depth == tileDepth + 1);
+    if (tileCount != (reachedTiles ? level.size() : 0)) {
+        throw runtime_error("Corrupt .qtc data: tile index does not match the tree");
+    }
+
+    // Only tiles over the region are read, the rest stay leaves holding their average
+    bool everyTile = true;
+    for (uint32_t i = 0; i < tileCount; i++) {
+        QuadTreeNode* tile = level[i];
+        uint32_t bytes = offsets[i + 1] - offsets[i];
+        if (tile->isLeafNode()) {
+            if (bytes != 0) throw runtime_error("Corrupt .qtc data: leaf tile with data");
+            continue;
+        }
+        if (!intersects(tile, region)) {
+            tile->setLeaf(true);
+            everyTile = false;
+            continue;
+        }
+
+        if (!in.seekg(tileStart + static_cast<streamoff>(offsets[i]))) {
+            throw runtime_error("Unexpected end of .qtc data");
+        }
+        readBytes(in, segment, bytes);
+        Models tileModels = *models;
+        RangeDecoder rc(segment.data(), segment.size());
+        vector<QuadTreeNode*> tileParents = {tile};
+        vector<QuadTreeNode*> tileLevel = splitAll(tileParents, arena);
+        while (!tileLevel.empty()) {
+            vector<QuadTreeNode*> tileSplits = decodeLevel(tileLevel, tileParents, tileModels, rc, nodesLeft);
+            tileLevel = splitAll(tileSplits, arena);
+            tileParents.swap(tileSplits);
+        }
+    }
+
+    if (everyTile && nodesLeft != 0) {
+        throw runtime_error("Corrupt .qtc data: fewer nodes than the header declares");
+    }
+    if (!in.seekg(tileStart + static_cast<streamoff>(offsets[tileCount]))) {
+        throw runtime_error("Unexpected end of .qtc data");
+    }
+    return root;
+}
@@ -0,0 +1,56 @@
+#ifndef QTCFORMAT_HPP
+#define QTCFORMAT_HPP
+
+#include "QuadTreeNode.hpp"
+#include "NodeArena.hpp"
+#include "LinearQuadTree.hpp"
+#include <cstdint>
+#include <iosfwd>
+
+// Native .qtc serialization of a quadtree:
+//   "QTC3", width, height (u32), method (u8), node count, level count (u32)
+//   bytes of each level's segment (u32 per level)
+//   one range coded segment per depth, nodes breadth-first within it
+// Each node codes its split flag (context: depth), then its average color as
+// a delta from a prediction (context: depth, leaf or not, channel). The
+// prediction is the parent's average, or for the fourth child what the parent
+// and its three siblings leave over; green and blue also follow red's error.
+// Blocks too small to split ((w / 2) * (h / 2) <= 1) are always leaves and
+// code no flag; geometry is rederived from the image size. Internal nodes
+// keep their averages, so a reader may stop after any level for a preview.
+namespace QtcFormat {
+    struct Header {
+        int width;
+        int height;
+        int method;
+    };
+
+    struct Region {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    // Writers take the flat tree: its breadth-first array is already in coding order
+    bool write(ostream& out, const LinearQuadTree& tree, const Header& header);
+
+    // Rebuilds the tree into arena and returns its root, throws runtime_error on malformed input.
+    // With maxDepth >= 0 only levels up to it are decoded and nodes at maxDepth become leaves.
+    QuadTreeNode* read(istream& in, NodeArena& arena, Header& header, int maxDepth = -1);
+
+    // Tiled "QTT1" variant for region-of-interest reads:
+    //   "QTT1", width, height (u32), method (u8), node count (u32), tile depth (u8),
+    //   top bytes, tile count (u32), tile offsets (u32, tile count + 1)
+    //   top segment: levels 0..tile depth breadth-first, coded as above
+    //   tile segments: the subtree below each node at tile depth, breadth-first,
+    //   each coded alone from the models the top segment left behind (empty for leaves)
+    bool writeTiled(ostream& out, const LinearQuadTree& tree, const Header& header, int tileDepth);
+    int defaultTileDepth(int width, int height); // tiles of at most 256 x 256 pixels
+
+    // Decodes the top levels and only the tiles intersecting region, other tiles
+    // become leaves holding their average. in must be seekable.
+    QuadTreeNode* readRegion(istream& in, NodeArena& arena, Header& header, const Region& region);
+}
+
+#endif // QTCFORMAT_HPP
@@ -0,0 +1,52 @@
+#include "QuadGrid.hpp"
+
+QuadGrid::QuadGrid(int width, int height, int minCellSize) {
+    if (minCellSize < 1) minCellSize = 1;
+
+    // Deepest level whose smallest cell is still minCellSize wide and high
+    int levels = 1;
+    while ((width >> levels) >= minCellSize && (height >> levels) >= minCellSize && levels < 16) {
+        levels++;
+    }
+
+    xBounds = subdivide(width, levels);
+    yBounds = subdivide(height, levels);
+    xCell = cellStarts(xBounds, width);
+    yCell = cellStarts(yBounds, height);
+}
+
+vector<vector<int>> QuadGrid::subdivide(int length, int levels) {
+    vector<vector<int>> bounds(levels);
+    bounds[0] = {0, length};
+    for (int d = 1; d < levels; d++) {
+        const vector<int>& parent = bounds[d - 1];
+        for (size_t i = 0; i + 1 < parent.size(); i++) {
+            bounds[d].push_back(parent[i]);
+            bounds[d].push_back(parent[i] + (parent[i + 1] - parent[i]) / 2);
+        }
+        bounds[d].push_back(length);
+    }
+    return bounds;
+}
+
+vector<vector<int>> QuadGrid::cellStarts(const vector<vector<int>>& bounds, int length) {
+    vector<vector<int>> starts(bounds.size(), vector<int>(length + 1, -1));
+    for (size_t d = 0; d < bounds.size(); d++) {
+        for (size_t i = 0; i + 1 < bounds[d].size(); i++) {
+            starts[d][bounds[d][i]] = static_cast<int>(i);
+        }
+    }
+    return starts;
+}
+
+long long QuadGrid::cellIndex(int level, int x, int y, int width, int height) const {
+    if (level < 0 || level >= getLevels()) return -1;
+    if (x < 0 || y < 0 || x >= static_cast<int>(xCell[level].size()) || y >= static_cast<int>(yCell[level].size())) return -1;
+
+    int column = xCell[level][x];
+    int row = yCell[level][y];
+    if (column < 0 || row < 0) return -1;
+    if (cellWidth(level, column) != width || cellHeight(level, row) != height) return -1;
+
+    return (static_cast<long long>(row) << level) + column;
+}
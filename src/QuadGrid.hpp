@@ -0,0 +1,37 @@
+#ifndef QUADGRID_HPP
+#define QUADGRID_HPP
+
+#include <vector>
+using namespace std;
+
+// The blocks a quadtree over a width x height image can produce. Level d is
+// a 2^d x 2^d grid obtained by halving the image d times exactly like
+// QuadTreeNode does (the first half gets the floor), so a node at depth d
+// is exactly one cell. Levels stop once a cell would be narrower or lower
+// than minCellSize.
+class QuadGrid {
+public:
+    QuadGrid(int width, int height, int minCellSize);
+
+    int getLevels() const { return static_cast<int>(xBounds.size()); }
+    int getFinestLevel() const { return getLevels() - 1; }
+
+    // Cell index row * 2^level + column, or -1 when the block is not a cell
+    long long cellIndex(int level, int x, int y, int width, int height) const;
+
+    int cellX(int level, int column) const { return xBounds[level][column]; }
+    int cellY(int level, int row) const { return yBounds[level][row]; }
+    int cellWidth(int level, int column) const { return xBounds[level][column + 1] - xBounds[level][column]; }
+    int cellHeight(int level, int row) const { return yBounds[level][row + 1] - yBounds[level][row]; }
+
+private:
+    vector<vector<int>> xBounds; // xBounds[d][i] .. xBounds[d][i + 1] is column i at level d
+    vector<vector<int>> yBounds;
+    vector<vector<int>> xCell;   // xCell[d][x] is the column starting at x, -1 if none
+    vector<vector<int>> yCell;
+
+    static vector<vector<int>> subdivide(int length, int levels);
+    static vector<vector<int>> cellStarts(const vector<vector<int>>& bounds, int length);
+};
+
+#endif // QUADGRID_HPP
@@ -1,37 +1,179 @@
 #include "QuadTree.hpp"
+#include "ThreadPool.hpp"
+#include "QtcFormat.hpp"
+#include <chrono>
 #include <fstream>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <sstream>
 
-QuadTree::QuadTree(const Image& img, int method, double threshold, int minSize, bool targetOn)
+QuadTree::QuadTree(int method, double threshold, int minSize, bool targetOn, int threads)
     : root(nullptr), errorMethod(method), threshold(threshold), minBlockSize(minSize),
-      originalWidth(img.getWidth()), originalHeight(img.getHeight()), targetOn(targetOn) {
-    if (minSize < 1) {
+      originalWidth(0), originalHeight(0), targetOn(targetOn),
+      compressNow(false), threadCount(1), parallelCutoff(DEFAULT_PARALLEL_CUTOFF), annotated(false) {
+    validate();
+    setThreadCount(threads);
+}
+
+QuadTree::QuadTree(const Image& img, int method, double threshold, int minSize, bool targetOn, int threads)
+    : QuadTree(method, threshold, minSize, targetOn, threads) {
+    compressImage(img);
+}
+
+QuadTree::QuadTree(const Image& img, const IntegralImage& stats, int method, double threshold, int minSize, bool targetOn, int threads)
+    : QuadTree(method, threshold, minSize, targetOn, threads) {
+    compressImage(img, stats);
+}
+
+QuadTree::~QuadTree() {
+    clear();
+}
+
+QuadTree::QuadTree(QuadTree&& other) noexcept
+    : arenas(move(other.arenas)), root(other.root), errorMethod(other.errorMethod), threshold(other.threshold),
+      minBlockSize(other.minBlockSize), originalWidth(other.originalWidth), originalHeight(other.originalHeight),
+      targetOn(other.targetOn), compressNow(other.compressNow), threadCount(other.threadCount),
+      parallelCutoff(other.parallelCutoff), annotated(other.annotated) {
+    other.arenas.clear();
+    other.root = nullptr;
+    other.annotated = false;
+}
+
+QuadTree& QuadTree::operator=(QuadTree&& other) noexcept {
+    if (this == &other) return *this;
+
+    // Moving the arenas in releases the nodes of the tree we held before
+    arenas = move(other.arenas);
+    root = other.root;
+    errorMethod = other.errorMethod;
+    threshold = other.threshold;
+    minBlockSize = other.minBlockSize;
+    originalWidth = other.originalWidth;
+    originalHeight = other.originalHeight;
+    targetOn = other.targetOn;
+    compressNow = other.compressNow;
+    threadCount = other.threadCount;
+    parallelCutoff = other.parallelCutoff;
+    annotated = other.annotated;
+
+    other.arenas.clear();
+    other.root = nullptr;
+    other.annotated = false;
+    return *this;
+}
+
+void QuadTree::clear() {
+    arenas.clear();
+    root = nullptr;
+    annotated = false;
+}
+
+size_t QuadTree::allocatedNodes() const {
+    size_t total = 0;
+    for (const NodeArena& arena : arenas) {
+        total += arena.size();
+    }
+    return total;
+}
+
+void QuadTree::validate() const {
+    if (minBlockSize < 1) {
         throw invalid_argument("Minimum block size must be at least 1");
     }
     if (threshold < 0) {
         throw invalid_argument("Threshold must be non-negative");
     }
+}
 
-    root = new QuadTreeNode(0, 0, originalWidth, originalHeight);
- 
-    compressImage(img);
+void QuadTree::setThreadCount(int threads) {
+    if (threads < 0) {
+        throw invalid_argument("Thread count must be non-negative");
+    }
+    threadCount = threads == 0 ? ThreadPool::defaultThreadCount() : threads;
 }
 
 void QuadTree::compressImage(const Image& img) {
-    if (root) {
-        root->compress(img, errorMethod, threshold, minBlockSize, targetOn);
+    IntegralImage stats(img, IntegralImage::planesForMethod(errorMethod));
+    compressImage(img, stats);
+}
+
+void QuadTree::compressImage(const Image& img, const IntegralImage& stats) {
+    build(img, stats, false);
+}
+
+void QuadTree::buildAnnotated(const Image& img, const IntegralImage& stats) {
+    build(img, stats, true);
+    cut(threshold);
+}
+
+void QuadTree::cut(double newThreshold) {
+    if (!annotated) {
+        throw logic_error("Only an annotated tree can be cut at a new threshold");
     }
+    if (newThreshold < 0) {
+        throw invalid_argument("Threshold must be non-negative");
+    }
+    threshold = newThreshold;
+    root->applyCut(errorMethod, threshold);
+}
+
+void QuadTree::build(const Image& img, const IntegralImage& stats, bool annotate) {
+    // Drop any previous tree in one shot before building a new one
+    arenas.clear();
+    arenas.resize(threadCount + 1);
+    originalWidth = img.getWidth();
+    originalHeight = img.getHeight();
+    root = arenas[0].allocate(0, 0, originalWidth, originalHeight);
+    annotated = annotate;
+
+    unique_ptr<MinMaxPyramid> minMax;
+    unique_ptr<EntropyPyramid> entropy;
+    if (errorMethod == 3) {
+        minMax = make_unique<MinMaxPyramid>(img);
+    } else if (errorMethod == 4) {
+        entropy = make_unique<EntropyPyramid>(img);
+    }
+
+    BuildContext ctx{img, stats, minMax.get(), entropy.get(), errorMethod, threshold, minBlockSize, targetOn, arenas.data(), nullptr, parallelCutoff, annotate};
+
+    if (threadCount <= 1) {
+        root->compress(ctx);
+        return;
+    }
+
+    ThreadPool pool(threadCount);
+    ctx.pool = &pool;
+    pool.submit([this, &ctx] { root->compress(ctx); });
+    pool.wait();
 }
 
 void QuadTree::decompressImage(Image& img) const { // Fill the image with the average color of each node
-    if (root) {
+    if (!root) return;
+
+    if (threadCount <= 1 || static_cast<long long>(originalWidth) * originalHeight < 2LL * FILL_TASK_PIXELS) {
         root->fillImage(img);
+        return;
     }
+
+    ThreadPool pool(threadCount);
+    pool.submit([this, &img, &pool] { root->fillImage(img, pool, FILL_TASK_PIXELS); });
+    pool.wait();
+}
+
+void QuadTree::decompressRegion(Image& crop, int x, int y) const {
+    if (!root) return;
+    root->fillRegion(crop, x, y);
 }
 
 bool QuadTree::saveImage(const string& filename) const {
     if (!root) return false;
+
+    string extension = Image::extensionOf(filename);
+    if (extension == "qtc" || extension == "qtt") {
+        ofstream out(filename, ios::binary);
+        return out && (extension == "qtc" ? write(out) : writeTiled(out));
+    }
     
     Image decompressedImage(originalWidth, originalHeight);
     decompressImage(decompressedImage);
@@ -39,6 +181,69 @@ bool QuadTree::saveImage(const string& filename) const {
     return decompressedImage.save(filename);
 }
 
+size_t QuadTree::encodedSize(const string& extension) const {
+    if (!root) return 0;
+
+    if (extension == "qtc" || extension == "qtt") {
+        ostringstream out;
+        if (extension == "qtc") write(out);
+        else writeTiled(out);
+        return out.str().size();
+    }
+
+    Image decompressedImage(originalWidth, originalHeight);
+    decompressImage(decompressedImage);
+
+    return decompressedImage.encodedSize(extension);
+}
+
+bool QuadTree::write(ostream& out) const {
+    return toLinear().write(out);
+}
+
+QuadTree QuadTree::read(istream& in, int maxDepth) {
+    // Only the tree is stored, the build parameters are placeholders apart from the method
+    QuadTree tree(0, 0, 1, false);
+    tree.arenas.resize(1);
+    QtcFormat::Header header;
+    tree.root = QtcFormat::read(in, tree.arenas[0], header, maxDepth);
+    tree.errorMethod = header.method;
+    tree.originalWidth = header.width;
+    tree.originalHeight = header.height;
+    return tree;
+}
+
+QuadTree QuadTree::load(const string& filename, int maxDepth) {
+    ifstream in(filename, ios::binary);
+    if (!in) {
+        throw runtime_error("Cannot open " + filename);
+    }
+    return read(in, maxDepth);
+}
+
+bool QuadTree::writeTiled(ostream& out, int tileDepth) const {
+    return toLinear().writeTiled(out, tileDepth);
+}
+
+QuadTree QuadTree::readRegion(istream& in, int x, int y, int width, int height) {
+    QuadTree tree(0, 0, 1, false);
+    tree.arenas.resize(1);
+    QtcFormat::Header header;
+    tree.root = QtcFormat::readRegion(in, tree.arenas[0], header, QtcFormat::Region{x, y, width, height});
+    tree.errorMethod = header.method;
+    tree.originalWidth = header.width;
+    tree.originalHeight = header.height;
+    return tree;
+}
+
+QuadTree QuadTree::loadRegion(const string& filename, int x, int y, int width, int height) {
+    ifstream in(filename, ios::binary);
+    if (!in) {
+        throw runtime_error("Cannot open " + filename);
+    }
+    return readRegion(in, x, y, width, height);
+}
+
 double QuadTree::getCompressionRatio(const string& originalFile, const string& compressedFile) const {
     // Get the size of the original image and the compressed image
     size_t originalSize = 0;
@@ -65,34 +270,54 @@ double QuadTree::getCompressionRatio(const string& originalFile, const string& c
 }
 
 double QuadTree::getBestThreshold(const string& inputFilename, int method, double targetRatio) {
+    Image img(inputFilename);
+    return getBestThreshold(img, filesystem::file_size(inputFilename), Image::extensionOf(inputFilename), method, targetRatio);
+}
+
+double QuadTree::getBestThreshold(const Image& img, size_t originalSize, const string& extension, int method, double targetRatio,
+                                  vector<ThresholdProbe>* probes) {
+    IntegralImage stats(img, IntegralImage::planesForMethod(method));
+    return getBestThreshold(img, stats, originalSize, extension, method, targetRatio, probes);
+}
+
+double QuadTree::getBestThreshold(const Image& img, const IntegralImage& stats, size_t originalSize, const string& extension,
+                                  int method, double targetRatio, vector<ThresholdProbe>* probes, QuadTree* best) {
     if (targetRatio < 0 || targetRatio > 1) {
         throw invalid_argument("Target ratio must be between 0 and 1");
     }
+    if (originalSize == 0) {
+        throw invalid_argument("Original size must be positive");
+    }
 
     double low = 0.0;
     double high = getMaxThresholdForMethod(method);
     double bestThreshold = 0.0;
     double bestError = numeric_limits<double>::max();
-    const double tolerance = 0.01; 
+    // SSIM thresholds that matter sit just below 1, where 0.01 spans most of the
+    // range of sizes, so method 5 always runs every iteration
+    const double tolerance = (method == 5) ? 0.0 : 0.01;
     const int maxIterations = 15;
     int iteration = 0;
 
+    // One annotated tree serves every probe, each iteration only re-cuts it
+    QuadTree quadTree(method, 0, 1, targetOn, threadCount);
+    quadTree.buildAnnotated(img, stats);
 
     while (iteration < maxIterations && (high - low) > tolerance) {
         try {
-            Image img(inputFilename);
-            size_t originalSize = filesystem::file_size(inputFilename);
+            auto probeStart = chrono::steady_clock::now();
             double mid = (low + high) / 2.0;
-            string tempOutput = "temp_" + filesystem::path(inputFilename).filename().string();
 
-            QuadTree quadTree(img, method, mid, 1, targetOn);
-            quadTree.compressImage(img); // Compress the image with the current threshold
-       
-            if (!quadTree.saveImage(tempOutput)) {
-                throw runtime_error("Failed to save temporary image.");
-            }
+            quadTree.cut(mid);
 
-            size_t compressedSize = filesystem::file_size(tempOutput);
+            size_t compressedSize = quadTree.encodedSize(extension);
+            if (compressedSize == 0) {
+                throw runtime_error("Failed to encode candidate image.");
+            }
+            if (probes) {
+                probes->push_back(ThresholdProbe{mid, compressedSize,
+                                                 chrono::duration<double, milli>(chrono::steady_clock::now() - probeStart).count()});
+            }
             double currentRatio = static_cast<double>(compressedSize) / originalSize;
             double currentError = abs(currentRatio - targetRatio);
 
@@ -116,16 +341,21 @@ double QuadTree::getBestThreshold(const string& inputFilename, int method, doubl
             }
 
             iteration++;
-            filesystem::remove(tempOutput); // Clean up temporary file
         } 
         catch (const exception& e) {
             cerr << "Error in iteration " << iteration << ": " << e.what() << std::endl;
+            iteration++; // a failing probe must not retry the same threshold forever
         }
      }
+
+    if (best) {
+        quadTree.cut(bestThreshold);
+        *best = move(quadTree);
+    }
     return bestThreshold;
 }
 
-double QuadTree::getMaxThresholdForMethod(int method) const {
+double QuadTree::getMaxThresholdForMethod(int method) {
     switch(method) {
         case 1: return 16256.25;   // Variance
         case 2: return 127.5;    // MAD
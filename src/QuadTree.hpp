@@ -3,20 +3,81 @@
 
 #include "Image.hpp"
 #include "QuadTreeNode.hpp"
+#include "NodeArena.hpp"
+#include "LinearQuadTree.hpp"
+
+// One threshold search iteration, logged when the caller asks for it
+struct ThresholdProbe {
+    double threshold;
+    size_t encodedSize;
+    double milliseconds;
+};
 
 class QuadTree {
 public:
-    QuadTree(const Image& img, const int method, double threshold, int minSize, bool targetOn);
+    // Deferred: only stores the parameters, nothing is built until compressImage()
+    QuadTree(const int method, double threshold, int minSize, bool targetOn, int threads = 1);
+    QuadTree(const Image& img, const int method, double threshold, int minSize, bool targetOn, int threads = 1);
+    QuadTree(const Image& img, const IntegralImage& stats, const int method, double threshold, int minSize, bool targetOn, int threads = 1);
+    ~QuadTree();
+
+    // The tree owns its nodes: moving hands them over in O(1), copying is not allowed
+    QuadTree(const QuadTree&) = delete;
+    QuadTree& operator=(const QuadTree&) = delete;
+    QuadTree(QuadTree&& other) noexcept;
+    QuadTree& operator=(QuadTree&& other) noexcept;
 
     void compressImage(const Image& img);
+    void compressImage(const Image& img, const IntegralImage& stats);
+    bool isBuilt() const { return root != nullptr; }
+    void clear();
+    size_t allocatedNodes() const;
+
+    // Build once, cut many: the annotated tree splits every block it may and
+    // keeps each node's error, so any threshold becomes a cheap re-marking pass.
+    void buildAnnotated(const Image& img, const IntegralImage& stats);
+    void cut(double newThreshold);
+    bool isAnnotated() const { return annotated; }
+
     void decompressImage(Image& img) const;
-    bool saveImage(const string& filename) const;
+    void decompressRegion(Image& crop, int x, int y) const; // crop receives the block of its own size at (x, y)
+    bool saveImage(const string& filename) const; // a .qtc/.qtt name stores the tree itself, anything else a raster
+    size_t encodedSize(const string& extension) const;
     double getCompressionRatio(const string& inputFilename, const string& outputFilename) const;
     QuadTreeNode* getRoot() const { return root; }
+    int getMethod() const { return errorMethod; }
+    LinearQuadTree toLinear() const { return LinearQuadTree(root, originalWidth, originalHeight, errorMethod); }
     double getBestThreshold(const string& inputFilename, int method, double targetRatio);
-    double getMaxThresholdForMethod(int method) const;
+    double getBestThreshold(const Image& img, size_t originalSize, const string& extension, int method, double targetRatio,
+                            vector<ThresholdProbe>* probes = nullptr);
+    // best, when given, receives the search's annotated tree cut at the threshold returned
+    double getBestThreshold(const Image& img, const IntegralImage& stats, size_t originalSize, const string& extension,
+                            int method, double targetRatio, vector<ThresholdProbe>* probes = nullptr,
+                            QuadTree* best = nullptr);
+    static double getMaxThresholdForMethod(int method);
+
+    // Native .qtc tree format, see QtcFormat.hpp
+    bool write(ostream& out) const;
+    static QuadTree read(istream& in, int maxDepth = -1); // maxDepth >= 0 reads a coarser preview
+    static QuadTree load(const string& filename, int maxDepth = -1);
+
+    // Tiled .qtt variant: only the tiles a region touches are read back
+    bool writeTiled(ostream& out, int tileDepth = -1) const; // -1 picks QtcFormat::defaultTileDepth
+    static QuadTree readRegion(istream& in, int x, int y, int width, int height);
+    static QuadTree loadRegion(const string& filename, int x, int y, int width, int height);
+
+    void setThreadCount(int threads); // 1 builds serially, 0 uses every hardware thread
+    void setParallelCutoff(int pixels) { parallelCutoff = pixels; }
+    int getThreadCount() const { return threadCount; }
+
+    static const int DEFAULT_PARALLEL_CUTOFF = 64 * 64;
+    static const int FILL_TASK_PIXELS = 256 * 256; // painting is cheap per pixel, so fill tasks are kept coarser
 
 private:
+    void validate() const;
+    void build(const Image& img, const IntegralImage& stats, bool annotate);
+
+    vector<NodeArena> arenas; // own every node of the tree, one per build thread
     QuadTreeNode* root;
     int errorMethod;
     double threshold;
@@ -25,6 +86,9 @@ private:
     int originalHeight;
     bool targetOn;
     bool compressNow;
+    int threadCount;
+    int parallelCutoff;
+    bool annotated;
 };
 
 #endif // QUADTREE_HPP
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "QuadTreeNode.hpp"
+#include "NodeArena.hpp"
+#include "ThreadPool.hpp"
+#include "BlockKernels.hpp"
 #include <cmath>
 #include <algorithm>
 #include <numeric>
@@ -6,19 +9,17 @@
 #include <limits>
 #include <iostream>
 
-QuadTreeNode::QuadTreeNode(int x, int y, int width, int height) 
-    : x(x), y(y), width(width), height(height), isLeaf(false), avgColor{0, 0, 0}, children{nullptr, nullptr, nullptr, nullptr} {
+NodeArena& BuildContext::arena() const {
+    return arenas[pool ? pool->workerIndex() + 1 : 0];
 }
 
-QuadTreeNode::~QuadTreeNode() {
-    for (int i = 0; i < 4; i++) {
-        delete children[i];
-    }
+QuadTreeNode::QuadTreeNode(int x, int y, int width, int height, int level) 
+    : x(x), y(y), width(width), height(height), isLeaf(false), level(static_cast<unsigned char>(level)), avgColor{0, 0, 0}, errorValue(0.0), children(nullptr) {
 }
 
 QuadTreeNode* QuadTreeNode::getChild(int index) const {
-    if (index < 0 || index > 3) return nullptr;
-    return children[index];
+    if (index < 0 || index > 3 || !children) return nullptr;
+    return &children[index];
 }
 
 int QuadTreeNode::getWidth() const {
@@ -32,16 +33,20 @@ int QuadTreeNode::getHeight() const {
 int QuadTreeNode::countLeafNodes() const {
     if (isLeaf) return 1;
     int count = 0;
-    for (int i = 0; i < 4; i++) {
-        if (children[i]) count += children[i]->countLeafNodes();
+    if (children) {
+        for (int i = 0; i < 4; i++) {
+            count += children[i].countLeafNodes();
+        }
     }
     return count;
 }
 
 int QuadTreeNode::countTotalNodes() const {
     int count = 1; // Count this node
-    for (int i = 0; i < 4; i++) {
-        if (children[i]) count += children[i]->countTotalNodes();
+    if (!isLeaf && children) {
+        for (int i = 0; i < 4; i++) {
+            count += children[i].countTotalNodes();
+        }
     }
     return count;
 }
@@ -49,9 +54,9 @@ int QuadTreeNode::countTotalNodes() const {
 int QuadTreeNode::depth() const {
     if (isLeaf) return 0;
     int maxDepth = -1;
-    for (int i = 0; i < 4; i++) {
-        if (children[i]) {
-            int childDepth = children[i]->depth();
+    if (children) {
+        for (int i = 0; i < 4; i++) {
+            int childDepth = children[i].depth();
             if (childDepth > maxDepth) {
                 maxDepth = childDepth;
             }
@@ -60,10 +65,10 @@ int QuadTreeNode::depth() const {
     return maxDepth + 1;
 }
 
-void QuadTreeNode::compress(const Image& img, const int method, double threshold, int minBlockSize, bool targetOn) {
+void QuadTreeNode::compress(const BuildContext& ctx) {
 
-    if (method == 5) {
-        compressWithSSIM(img, threshold, minBlockSize, targetOn);
+    if (ctx.method == 5) {
+        compressWithSSIM(ctx);
         return;
     }
     
@@ -73,27 +78,27 @@ void QuadTreeNode::compress(const Image& img, const int method, double threshold
     int subHeight1 = height / 2;
     int subHeight2 = height - subHeight1;
 
-    if (!targetOn) {
+    if (!ctx.targetOn) {
         // Stop if current block area is too small
-        if (width * height <= minBlockSize) {
-            calculateAverageColor(img);
+        if (width * height <= ctx.minBlockSize) {
+            calculateAverageColor(ctx.stats);
             isLeaf = true;
             return;
         }
 
         // Stop if ANY sub-block would be too small
-        if (subWidth1 * subHeight1 < minBlockSize || 
-            subWidth1 * subHeight2 < minBlockSize || 
-            subWidth2 * subHeight1 < minBlockSize || 
-            subWidth2 * subHeight2 < minBlockSize) {
-            calculateAverageColor(img);
+        if (subWidth1 * subHeight1 < ctx.minBlockSize || 
+            subWidth1 * subHeight2 < ctx.minBlockSize || 
+            subWidth2 * subHeight1 < ctx.minBlockSize || 
+            subWidth2 * subHeight2 < ctx.minBlockSize) {
+            calculateAverageColor(ctx.stats);
             isLeaf = true;
             return;
         }
     }
 
     if (width * height <= 1) {
-        calculateAverageColor(img);
+        calculateAverageColor(ctx.stats);
         isLeaf = true;
         return;
     }
@@ -103,133 +108,75 @@ void QuadTreeNode::compress(const Image& img, const int method, double threshold
         subWidth1 * subHeight2 <= 1 || 
         subWidth2 * subHeight1 <= 1 || 
         subWidth2 * subHeight2 <= 1) {
-        calculateAverageColor(img);
+        calculateAverageColor(ctx.stats);
         isLeaf = true;
         return;
     }
     
 
     double error = 0.0;
-    if (method == 1) {
-        error = calculateVariance(img);
-    } else if (method == 2) {
-        error = calculateMAD(img);
-    } else if (method == 3) {
-        error = calculateMaxDifference(img);
-    } else if (method == 4) {
-        error = calculateEntropy(img);
+    if (ctx.method == 1) {
+        error = calculateVariance(ctx.stats);
+    } else if (ctx.method == 2) {
+        error = calculateMAD(ctx.img, ctx.stats);
+    } else if (ctx.method == 3) {
+        error = calculateMaxDifference(ctx.img, ctx.minMax);
+    } else if (ctx.method == 4) {
+        error = calculateEntropy(ctx.img, ctx.entropy);
     }
 
-    if (error <= threshold) {
-        calculateAverageColor(img);
+    errorValue = error;
+    if (!ctx.annotate && error <= ctx.threshold) {
+        calculateAverageColor(ctx.stats);
         isLeaf = true;
     } else {
-        int halfWidth = width / 2;
-        int halfHeight = height / 2;
-        int remainingWidth = width - halfWidth;
-        int remainingHeight = height - halfHeight;
-        
-        children[0] = new QuadTreeNode(x, y, halfWidth, halfHeight);
-        children[1] = new QuadTreeNode(x + halfWidth, y, remainingWidth, halfHeight);
-        children[2] = new QuadTreeNode(x, y + halfHeight, halfWidth, remainingHeight);
-        children[3] = new QuadTreeNode(x + halfWidth, y + halfHeight, remainingWidth, remainingHeight);
-
-        for (int i = 0; i < 4; i++) {
-            if (children[i]) {
-                children[i]->compress(img, method, threshold, minBlockSize, targetOn);
-            }
-        }
+        // Internal averages predict the children in .qtc streams, and after a cut any node may be a leaf
+        calculateAverageColor(ctx.stats);
+        split(ctx.arena());
+        compressChildren(ctx);
     }
 }
 
-double QuadTreeNode::calculateVariance(const Image& img) const {
-    double mean[3] = {0};
-    double variance[3] = {0};
-    int pixelCount = 0;
-    int imgWidth = img.getWidth();
-    int imgHeight = img.getHeight();
-
-    // Calculate mean
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            mean[0] += img.getPixel(x_pos, y_pos, 0);
-            mean[1] += img.getPixel(x_pos, y_pos, 1);
-            mean[2] += img.getPixel(x_pos, y_pos, 2);
-            pixelCount++;
-        }
-    }
-
-    if (pixelCount == 0) return 0.0;
-
-    for (int k = 0; k < 3; k++) {
-        mean[k] /= pixelCount;
-    }
-
-    // Calculate variance ()
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            variance[0] += pow(img.getPixel(x_pos, y_pos, 0) - mean[0], 2);
-            variance[1] += pow(img.getPixel(x_pos, y_pos, 1) - mean[1], 2);
-            variance[2] += pow(img.getPixel(x_pos, y_pos, 2) - mean[2], 2);
-        }
-    }
-
-    return (variance[0] + variance[1] + variance[2]) / (3 * pixelCount);
+double QuadTreeNode::calculateVariance(const IntegralImage& stats) const {
+    return stats.variance(x, y, width, height);
 }
 
-double QuadTreeNode::calculateMAD(const Image& img) const {
+double QuadTreeNode::calculateMAD(const Image& img, const IntegralImage& stats) const {
     double mean[3] = {0};
     double mad[3] = {0};
-    int pixelCount = 0;
-    int imgWidth = img.getWidth();
-    int imgHeight = img.getHeight();
-
-    // Calculate mean
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            mean[0] += img.getPixel(x_pos, y_pos, 0);
-            mean[1] += img.getPixel(x_pos, y_pos, 1);
-            mean[2] += img.getPixel(x_pos, y_pos, 2);
-            pixelCount++;
-        }
-    }
+    int pixelCount = stats.pixelCount(x, y, width, height);
 
     if (pixelCount == 0) return 0.0;
 
-    for (int k = 0; k < 3; k++) {
-        mean[k] /= pixelCount;
-    }
+    // Mean comes from the summed-area table, only the deviation needs a pixel pass
+    stats.mean(x, y, width, height, mean);
 
-    // absolute of (pixel - mean)
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            mad[0] += abs(img.getPixel(x_pos, y_pos, 0) - mean[0]);
-            mad[1] += abs(img.getPixel(x_pos, y_pos, 1) - mean[1]);
-            mad[2] += abs(img.getPixel(x_pos, y_pos, 2) - mean[2]);
-        }
+    // absolute of (pixel - mean), one channel at a time so planar rows are read contiguously
+    Image::BlockView<const unsigned char> block = img.view(x, y, width, height);
+    for (int c = 0; c < 3; c++) {
+        mad[c] = BlockKernels::absDeviation(block, c, mean[c]);
     }
 
     return (mad[0] + mad[1] + mad[2]) / (3 * pixelCount);
 }
 
-double QuadTreeNode::calculateMaxDifference(const Image& img) const {
+double QuadTreeNode::calculateMaxDifference(const Image& img, const MinMaxPyramid* minMax) const {
     int minVal[3] = {numeric_limits<int>::max(), 
                     numeric_limits<int>::max(), 
                     numeric_limits<int>::max()};
     int maxVal[3] = {numeric_limits<int>::min(), 
                     numeric_limits<int>::min(), 
                     numeric_limits<int>::min()};
-    int imgWidth = img.getWidth();
-    int imgHeight = img.getHeight();
-
-    // Calculate min and max values for each channel
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            for (int c = 0; c < 3; c++) {
-                int val = img.getPixel(x_pos, y_pos, c);
-                minVal[c] = min(minVal[c], val);
-                maxVal[c] = max(maxVal[c], val);
-            }
+
+    // Blocks the pyramid covers are a single lookup, only small deep blocks are scanned
+    if (!minMax || !minMax->range(level, x, y, width, height, minVal, maxVal)) {
+        // Calculate min and max values for each channel
+        Image::BlockView<const unsigned char> block = img.view(x, y, width, height);
+        for (int c = 0; c < 3; c++) {
+            unsigned char lo = 255, hi = 0;
+            BlockKernels::minMax(block, c, lo, hi);
+            minVal[c] = lo;
+            maxVal[c] = hi;
         }
     }
     
@@ -242,109 +189,41 @@ double QuadTreeNode::calculateMaxDifference(const Image& img) const {
     return maxDiff / 3.0;
 }
 
-double QuadTreeNode::calculateEntropy(const Image& img) const {
-    int occ[3][256] = {0};
-    int pixelCount = 0;
-    int imgWidth = img.getWidth();
-    int imgHeight = img.getHeight();
-
-    // calculate occurences of each pixel value for each channel
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            for (int c = 0; c < 3; c++) {
-                int val = img.getPixel(x_pos, y_pos, c);
-                occ[c][val]++;
-            }
-            pixelCount++;
-        }
-    }
-
-    if (pixelCount == 0) return 0.0;
-
-    // calculate entropy for each channel
-    double entropy[3] = {0};
-    for (int c = 0; c < 3; c++) {
-        for (int val = 0; val < 256; val++) {
-            if (occ[c][val] > 0) {
-                double p = static_cast<double>(occ[c][val]) / pixelCount;
-                entropy[c] -= p * log2(p);
-            }
-        }
+double QuadTreeNode::calculateEntropy(const Image& img, const EntropyPyramid* entropy) const {
+    // Blocks the pyramid covers were computed bottom-up from merged histograms
+    double value = 0.0;
+    if (entropy && entropy->entropy(level, x, y, width, height, value)) {
+        return value;
     }
-
-    return (entropy[0] + entropy[1] + entropy[2]) / 3.0;
+    return EntropyPyramid::blockEntropy(img, x, y, width, height);
 }
 
 
 // Constants for SSIM calculation
 
 
-double QuadTreeNode::calculateSSIM(const Image& img1, const Image& img2, int x1, int y1, int x2, int y2, int width, int height) {
+double QuadTreeNode::calculateSSIM(const IntegralImage& stats) const {
     const double C1 = 6.5025;  // (0.01*255)^2
     const double C2 = 58.5225; // (0.03*255)^2
-    const double C3 = C2 / 2;
-    double sumX = 0.0, sumY = 0.0;
-    double sumX2 = 0.0, sumY2 = 0.0;
-    double sumXY = 0.0;
-    int pixelCount = 0;
-    
-    int img1Width = img1.getWidth();
-    int img1Height = img1.getHeight();
-    int img2Width = img2.getWidth();
-    int img2Height = img2.getHeight();
-    
-    for (int dy = 0; dy < height; dy++) {
-        for (int dx = 0; dx < width; dx++) {
-            int px1 = x1 + dx;
-            int py1 = y1 + dy;
-            int px2 = x2 + dx;
-            int py2 = y2 + dy;
-            
-           
-            if (px1 >= img1Width || py1 >= img1Height || px2 >= img2Width || py2 >= img2Height) {
-                continue;
-            }
-            
-            // Convert to luminance
-            double l1 = 0.299 * img1.getPixel(px1, py1, 0) + 
-                        0.587 * img1.getPixel(px1, py1, 1) + 
-                        0.114 * img1.getPixel(px1, py1, 2);
-            
-            double l2 = 0.299 * img2.getPixel(px2, py2, 0) + 
-                        0.587 * img2.getPixel(px2, py2, 1) + 
-                        0.114 * img2.getPixel(px2, py2, 2);
-            
-            sumX += l1;
-            sumY += l2;
-            sumX2 += l1 * l1;
-            sumY2 += l2 * l2;
-            sumXY += l1 * l2;
-            pixelCount++;
-        }
-    }
-    
-    if (pixelCount == 0) return 0.0;
-    
-    // Calculate means
-    double muX = sumX / pixelCount;
-    double muY = sumY / pixelCount;
-    
-    // Calculate variance and covariance
-    double sigmaX2 = (sumX2 / pixelCount) - (muX * muX);
-    double sigmaY2 = (sumY2 / pixelCount) - (muY * muY);
-    double sigmaXY = (sumXY / pixelCount) - (muX * muY);
-    
-    // Calculate SSIM components
+
+    if (stats.pixelCount(x, y, width, height) == 0) return 0.0;
+
+    // The block is compared against itself filled with avgColor. That image is
+    // constant, so its variance and the covariance are zero, and the structure
+    // term (sigmaXY + C3) / (sigmaX * sigmaY + C3) is exactly 1.
+    double muX = stats.luminanceMean(x, y, width, height);
+    double muY = 0.299 * avgColor[0] + 0.587 * avgColor[1] + 0.114 * avgColor[2];
+    double sigmaX2 = stats.luminanceVariance(x, y, width, height);
+
     double luminance = (2 * muX * muY + C1) / (muX * muX + muY * muY + C1);
-    double contrast = (2 * sqrt(sigmaX2) * sqrt(sigmaY2) + C2) / (sigmaX2 + sigmaY2 + C2);
-    double structure = (sigmaXY + C3) / (sqrt(sigmaX2) * sqrt(sigmaY2) + C3);
-    
-    return luminance * contrast * structure;
+    double contrast = C2 / (sigmaX2 + C2);
+
+    return luminance * contrast;
 }
 
 
 
-void QuadTreeNode::compressWithSSIM(const Image& img, double threshold, int minBlockSize, bool targetOn) {
+void QuadTreeNode::compressWithSSIM(const BuildContext& ctx) {
 
     // Calculate sub-block areas
     int subWidth1 = width / 2;
@@ -352,27 +231,27 @@ void QuadTreeNode::compressWithSSIM(const Image& img, double threshold, int minB
     int subHeight1 = height / 2;
     int subHeight2 = height - subHeight1;
 
-    if (!targetOn) {
+    if (!ctx.targetOn) {
         // Stop if current block area is too small
-        if (width * height <= minBlockSize) {
-            calculateAverageColor(img);
+        if (width * height <= ctx.minBlockSize) {
+            calculateAverageColor(ctx.stats);
             isLeaf = true;
             return;
         }
 
         // Stop if ANY sub-block would be too small
-        if (subWidth1 * subHeight1 < minBlockSize || 
-            subWidth1 * subHeight2 < minBlockSize || 
-            subWidth2 * subHeight1 < minBlockSize || 
-            subWidth2 * subHeight2 < minBlockSize) {
-            calculateAverageColor(img);
+        if (subWidth1 * subHeight1 < ctx.minBlockSize || 
+            subWidth1 * subHeight2 < ctx.minBlockSize || 
+            subWidth2 * subHeight1 < ctx.minBlockSize || 
+            subWidth2 * subHeight2 < ctx.minBlockSize) {
+            calculateAverageColor(ctx.stats);
             isLeaf = true;
             return;
         }
     }
 
     if (width * height <= 1) {
-        calculateAverageColor(img);
+        calculateAverageColor(ctx.stats);
         isLeaf = true;
         return;
     }
@@ -382,88 +261,107 @@ void QuadTreeNode::compressWithSSIM(const Image& img, double threshold, int minB
         subWidth1 * subHeight2 <= 1 || 
         subWidth2 * subHeight1 <= 1 || 
         subWidth2 * subHeight2 <= 1) {
-        calculateAverageColor(img);
+        calculateAverageColor(ctx.stats);
         isLeaf = true;
         return;
     }
     
     
     // Calculate the average color for the current node's region
-    calculateAverageColor(img);
-
-    // Create a temporary image filled with the average color
-    Image temp(width, height);
-    for (int y_pos = 0; y_pos < height; y_pos++) {
-        for (int x_pos = 0; x_pos < width; x_pos++) {
-            temp.setPixel(x_pos, y_pos, 0, static_cast<int>(avgColor[0]));
-            temp.setPixel(x_pos, y_pos, 1, static_cast<int>(avgColor[1]));
-            temp.setPixel(x_pos, y_pos, 2, static_cast<int>(avgColor[2]));
-        }
-    }
+    calculateAverageColor(ctx.stats);
 
-    // Calculate SSIM between the original region and the temp image
-    double ssim = calculateSSIM(img, temp, x, y, 0, 0, width, height);
+    // SSIM between the original region and the region filled with the average color
+    double ssim = calculateSSIM(ctx.stats);
+    errorValue = ssim;
     
-    if (ssim >= threshold) {
+    if (!ctx.annotate && ssim >= ctx.threshold) {
         isLeaf = true;
     } else {
         // Split into 4 children and compress them
-        int halfWidth = width / 2;
-        int halfHeight = height / 2;
-        int remainingWidth = width - halfWidth;
-        int remainingHeight = height - halfHeight;
-        
-        children[0] = new QuadTreeNode(x, y, halfWidth, halfHeight);
-        children[1] = new QuadTreeNode(x + halfWidth, y, remainingWidth, halfHeight);
-        children[2] = new QuadTreeNode(x, y + halfHeight, halfWidth, remainingHeight);
-        children[3] = new QuadTreeNode(x + halfWidth, y + halfHeight, remainingWidth, remainingHeight);
+        split(ctx.arena());
+        compressChildren(ctx);
+    }
+}
 
+void QuadTreeNode::applyCut(int method, double threshold) {
+    // Same decision compress() makes, read from the recorded error
+    if (!children) {
+        isLeaf = true;
+        return;
+    }
+    isLeaf = (method == 5) ? errorValue >= threshold : errorValue <= threshold;
+    if (!isLeaf) {
         for (int i = 0; i < 4; i++) {
-            if (children[i]) {
-                children[i]->compressWithSSIM(img, threshold, minBlockSize, targetOn);
-            }
+            children[i].applyCut(method, threshold);
         }
     }
 }
 
-void QuadTreeNode::calculateAverageColor(const Image& img) {
-    avgColor = {0, 0, 0};
-    int pixelCount = 0;
-    int imgWidth = img.getWidth();
-    int imgHeight = img.getHeight();
-
-    for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-        for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-            avgColor[0] += img.getPixel(x_pos, y_pos, 0);
-            avgColor[1] += img.getPixel(x_pos, y_pos, 1);
-            avgColor[2] += img.getPixel(x_pos, y_pos, 2);
-            pixelCount++;
+void QuadTreeNode::compressChildren(const BuildContext& ctx) {
+    // Large sub-blocks become pool tasks, small ones and the last child stay on this thread
+    for (int i = 0; i < 4; i++) {
+        QuadTreeNode* child = &children[i];
+        if (ctx.pool && i < 3 && child->width * child->height >= ctx.parallelCutoff) {
+            ctx.pool->submit([child, &ctx] { child->compress(ctx); });
+        } else {
+            child->compress(ctx);
         }
     }
+}
 
-    if (pixelCount > 0) {
-        for (int k = 0; k < 3; k++) {
-            avgColor[k] /= pixelCount;
-        }
-    }
+void QuadTreeNode::split(NodeArena& arena) { // Create the four sub-blocks as one contiguous block
+    children = arena.allocateChildren(x, y, width, height, level + 1);
+}
+
+void QuadTreeNode::calculateAverageColor(const IntegralImage& stats) {
+    stats.averageColor(x, y, width, height, avgColor);
 }
 
 void QuadTreeNode::fillImage(Image& img) const { // Fill the image with the average color of this node
     if (isLeaf) {
-        int imgWidth = img.getWidth();
-        int imgHeight = img.getHeight();
-        for (int y_pos = y; y_pos < y + height && y_pos < imgHeight; y_pos++) {
-            for (int x_pos = x; x_pos < x + width && x_pos < imgWidth; x_pos++) {
-                img.setPixel(x_pos, y_pos, 0, avgColor[0]);
-                img.setPixel(x_pos, y_pos, 1, avgColor[1]);
-                img.setPixel(x_pos, y_pos, 2, avgColor[2]);
-            }
+        // Averages of 8-bit pixels are already within 0-255, no clamping needed
+        const unsigned char color[3] = {static_cast<unsigned char>(avgColor[0]),
+                                        static_cast<unsigned char>(avgColor[1]),
+                                        static_cast<unsigned char>(avgColor[2])};
+        img.fillRect(x, y, width, height, color);
+    } else if (children) {
+        for (int i = 0; i < 4; i++) {
+            children[i].fillImage(img);
         }
-    } else {
+    }
+}
+
+void QuadTreeNode::fillRegion(Image& crop, int cropX, int cropY) const {
+    int left = max(x, cropX);
+    int top = max(y, cropY);
+    int right = min(x + width, cropX + crop.getWidth());
+    int bottom = min(y + height, cropY + crop.getHeight());
+    if (left >= right || top >= bottom) return; // subtrees outside the crop are never visited
+
+    if (isLeaf) {
+        const unsigned char color[3] = {static_cast<unsigned char>(avgColor[0]),
+                                        static_cast<unsigned char>(avgColor[1]),
+                                        static_cast<unsigned char>(avgColor[2])};
+        crop.fillRect(left - cropX, top - cropY, right - left, bottom - top, color);
+    } else if (children) {
         for (int i = 0; i < 4; i++) {
-            if (children[i]) {
-                children[i]->fillImage(img);
-            }
+            children[i].fillRegion(crop, cropX, cropY);
+        }
+    }
+}
+
+void QuadTreeNode::fillImage(Image& img, ThreadPool& pool, int parallelCutoff) const {
+    // Leaves never overlap, so subtrees can paint their part of the image concurrently
+    if (isLeaf || !children || width * height < parallelCutoff) {
+        fillImage(img);
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        const QuadTreeNode* child = &children[i];
+        if (i < 3) {
+            pool.submit([child, &img, &pool, parallelCutoff] { child->fillImage(img, pool, parallelCutoff); });
+        } else {
+            child->fillImage(img, pool, parallelCutoff);
         }
     }
 }
\ No newline at end of file
@@ -3,39 +3,79 @@
 
 
 #include "Image.hpp"
+#include "IntegralImage.hpp"
+#include "MinMaxPyramid.hpp"
+#include "EntropyPyramid.hpp"
 
 class Image;
+class NodeArena;
+class ThreadPool;
+
+// Shared, read-only state for building a tree. With a pool, sub-blocks of at
+// least parallelCutoff pixels are built as tasks, each worker allocating from
+// its own arena.
+struct BuildContext {
+    const Image& img;
+    const IntegralImage& stats;
+    const MinMaxPyramid* minMax; // only built for the Max Difference method
+    const EntropyPyramid* entropy; // only built for the Entropy method
+    int method;
+    double threshold;
+    int minBlockSize;
+    bool targetOn;
+    NodeArena* arenas; // arenas[0] for the calling thread, arenas[i + 1] for pool worker i
+    ThreadPool* pool;
+    int parallelCutoff;
+    bool annotate; // split every block that may be split and record its error instead of testing the threshold
+
+    NodeArena& arena() const;
+};
 
 class QuadTreeNode {
 public:
-    QuadTreeNode(int x, int y, int width, int height);
-    ~QuadTreeNode();
+    QuadTreeNode(int x, int y, int width, int height, int level = 0);
 
     QuadTreeNode* getChild(int index) const;
+    int getX() const { return x; }
+    int getY() const { return y; }
     int getWidth() const;
     int getHeight() const;
+    int getLevel() const { return level; }
     bool isLeafNode() const { return isLeaf; }
+    const int* getAvgColor() const { return avgColor; }
+    double getError() const { return errorValue; }
 
     int countLeafNodes() const;
     int countTotalNodes() const;
     int depth() const;
 
-    void compress(const Image& img, const int method, double threshold, int minBlockSize, bool targetOn);
+    void compress(const BuildContext& ctx);
+    void applyCut(int method, double threshold);
     void fillImage(Image& img) const;
+    void fillImage(Image& img, ThreadPool& pool, int parallelCutoff) const; // subtrees of at least parallelCutoff pixels become tasks
+    void fillRegion(Image& crop, int cropX, int cropY) const; // paints only what falls inside crop, placed at (cropX, cropY)
+
+    // For loaders that rebuild a tree from a stream rather than from pixels
+    void split(NodeArena& arena);
+    void setLeaf(bool leaf) { isLeaf = leaf; }
+    void setAvgColor(const int color[3]) { avgColor[0] = color[0]; avgColor[1] = color[1]; avgColor[2] = color[2]; }
 
 private:
     int x, y, width, height;
     bool isLeaf;
-    std::vector<int> avgColor;
-    QuadTreeNode* children[4];
-
-    void calculateAverageColor(const Image& img);
-    double calculateVariance(const Image& img) const;
-    double calculateMAD(const Image& img) const;
-    double calculateMaxDifference(const Image& img) const;
-    double calculateEntropy(const Image& img) const;
-    double calculateSSIM(const Image& img1, const Image& img2, int x1, int y1, int x2, int y2, int width, int height);
-    void compressWithSSIM(const Image& img, double threshold, int minBlockSize, bool targetOn);
+    unsigned char level; // depth below the root, selects the pyramid level
+    int avgColor[3];
+    double errorValue; // error (or SSIM) of this block, kept for threshold cuts
+    QuadTreeNode* children; // first of four contiguous children owned by the arena, nullptr for leaves
+
+    void calculateAverageColor(const IntegralImage& stats);
+    double calculateVariance(const IntegralImage& stats) const;
+    double calculateMAD(const Image& img, const IntegralImage& stats) const;
+    double calculateMaxDifference(const Image& img, const MinMaxPyramid* minMax) const;
+    double calculateEntropy(const Image& img, const EntropyPyramid* entropy) const;
+    double calculateSSIM(const IntegralImage& stats) const;
+    void compressWithSSIM(const BuildContext& ctx);
+    void compressChildren(const BuildContext& ctx);
 
 };
 
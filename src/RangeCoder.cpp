@@ -0,0 +1,108 @@
+#include "RangeCoder.hpp"
+#include <stdexcept>
+
+namespace {
+    const int PROBABILITY_BITS = 11;
+    const uint32_t PROBABILITY_ONE = 1u << PROBABILITY_BITS;
+    const int ADAPT_SHIFT = 5; // larger adapts slower but settles closer to the true probability
+    const uint32_t TOP = 1u << 24;
+}
+
+RangeEncoder::RangeEncoder(vector<unsigned char>& out)
+    : out(out), low(0), range(0xFFFFFFFFu), cache(0), cacheSize(1) {
+}
+
+void RangeEncoder::shiftLow() {
+    // A carry out of low has to ripple into the bytes held back in cache
+    if (static_cast<uint32_t>(low) < 0xFF000000u || (low >> 32) != 0) {
+        unsigned char carry = static_cast<unsigned char>(low >> 32);
+        unsigned char pending = cache;
+        do {
+            out.push_back(static_cast<unsigned char>(pending + carry));
+            pending = 0xFF;
+        } while (--cacheSize != 0);
+        cache = static_cast<unsigned char>(low >> 24);
+    }
+    cacheSize++;
+    low = (low & 0x00FFFFFFu) << 8;
+}
+
+void RangeEncoder::encodeBit(uint16_t& probability, int bit) {
+    uint32_t bound = (range >> PROBABILITY_BITS) * probability;
+    if (bit == 0) {
+        range = bound;
+        probability += (PROBABILITY_ONE - probability) >> ADAPT_SHIFT;
+    } else {
+        low += bound;
+        range -= bound;
+        probability -= probability >> ADAPT_SHIFT;
+    }
+    while (range < TOP) {
+        range <<= 8;
+        shiftLow();
+    }
+}
+
+void RangeEncoder::finish() {
+    for (int i = 0; i < 5; i++) {
+        shiftLow();
+    }
+}
+
+RangeDecoder::RangeDecoder(const unsigned char* data, size_t size)
+    : data(data), size(size), next(0), range(0xFFFFFFFFu), code(0) {
+    // The encoder always starts with a zero byte, then four bytes of code
+    for (int i = 0; i < 5; i++) {
+        code = (code << 8) | nextByte();
+    }
+}
+
+unsigned char RangeDecoder::nextByte() {
+    if (next >= size) {
+        throw runtime_error("Unexpected end of range coded data");
+    }
+    return data[next++];
+}
+
+int RangeDecoder::decodeBit(uint16_t& probability) {
+    uint32_t bound = (range >> PROBABILITY_BITS) * probability;
+    int bit;
+    if (code < bound) {
+        range = bound;
+        probability += (PROBABILITY_ONE - probability) >> ADAPT_SHIFT;
+        bit = 0;
+    } else {
+        code -= bound;
+        range -= bound;
+        probability -= probability >> ADAPT_SHIFT;
+        bit = 1;
+    }
+    while (range < TOP) {
+        range <<= 8;
+        code = (code << 8) | nextByte();
+    }
+    return bit;
+}
+
+ByteModel::ByteModel() {
+    for (uint16_t& p : probabilities) {
+        p = PROBABILITY_ONE / 2;
+    }
+}
+
+void ByteModel::encode(RangeEncoder& rc, int symbol) {
+    int node = 1;
+    for (int i = 7; i >= 0; i--) {
+        int bit = (symbol >> i) & 1;
+        rc.encodeBit(probabilities[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+int ByteModel::decode(RangeDecoder& rc) {
+    int node = 1;
+    while (node < 256) {
+        node = (node << 1) | rc.decodeBit(probabilities[node]);
+    }
+    return node - 256;
+}
@@ -0,0 +1,64 @@
+#ifndef RANGECODER_HPP
+#define RANGECODER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+// Binary adaptive range coder (LZMA style). Every decision is coded against
+// an 11-bit probability that drifts toward the symbols actually seen, so
+// skewed streams such as split flags and small color deltas cost well
+// under a bit per decision.
+class RangeEncoder {
+public:
+    explicit RangeEncoder(vector<unsigned char>& out);
+
+    void encodeBit(uint16_t& probability, int bit);
+    void finish(); // flush the pending bytes, the output is complete afterwards
+
+private:
+    vector<unsigned char>& out;
+    uint64_t low;
+    uint32_t range;
+    unsigned char cache;
+    uint64_t cacheSize;
+
+    void shiftLow();
+};
+
+class RangeDecoder {
+public:
+    RangeDecoder(const unsigned char* data, size_t size); // throws runtime_error on truncated input
+
+    int decodeBit(uint16_t& probability);
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t next;
+    uint32_t range;
+    uint32_t code;
+
+    unsigned char nextByte();
+};
+
+// Probability of a single yes/no decision
+struct BitModel {
+    uint16_t probability = 1 << 10;
+
+    void encode(RangeEncoder& rc, int bit) { rc.encodeBit(probability, bit); }
+    int decode(RangeDecoder& rc) { return rc.decodeBit(probability); }
+};
+
+// Adaptive model for 8-bit symbols, coded MSB first down a binary tree of
+// 255 decisions so each prefix of the symbol has its own probability
+struct ByteModel {
+    uint16_t probabilities[256];
+
+    ByteModel();
+    void encode(RangeEncoder& rc, int symbol);
+    int decode(RangeDecoder& rc);
+};
+
+#endif // RANGECODER_HPP
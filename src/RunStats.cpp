@@ -0,0 +1,238 @@
+#include "RunStats.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    string jsonString(const string& text) {
+        string quoted = "\"";
+        for (unsigned char c : text) {
+            switch (c) {
+                case '"': quoted += "\\\""; break;
+                case '\\': quoted += "\\\\"; break;
+                case '\n': quoted += "\\n"; break;
+                case '\r': quoted += "\\r"; break;
+                case '\t': quoted += "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        quoted += escaped;
+                    } else {
+                        quoted += static_cast<char>(c);
+                    }
+            }
+        }
+        return quoted + "\"";
+    }
+
+    // Enough digits to read back the same double, so a logged threshold reproduces its run
+    string exactNumber(double value) {
+        ostringstream out;
+        out.precision(numeric_limits<double>::max_digits10);
+        out << value;
+        return out.str();
+    }
+
+    size_t outputSize(const string& filename) {
+        error_code ec;
+        uintmax_t size = filesystem::file_size(filename, ec);
+        return ec ? 0 : static_cast<size_t>(size);
+    }
+}
+
+string RunStats::toJson() const {
+    ostringstream out;
+    out.precision(6); // timings; thresholds are written exactly
+    out << "{\"input\":" << jsonString(input)
+        << ",\"output\":" << jsonString(output)
+        << ",\"ok\":" << (ok ? "true" : "false");
+    if (!ok) out << ",\"error\":" << jsonString(error);
+    out << ",\"method\":" << method
+        << ",\"threshold\":" << exactNumber(threshold)
+        << ",\"min_block_size\":" << minBlockSize
+        << ",\"width\":" << width
+        << ",\"height\":" << height
+        << ",\"input_bytes\":" << inputBytes
+        << ",\"output_bytes\":" << outputBytes
+        << ",\"total_nodes\":" << totalNodes
+        << ",\"leaf_nodes\":" << leafNodes
+        << ",\"depth\":" << depth
+        << ",\"timings_ms\":{\"decode\":" << decodeMs
+        << ",\"search\":" << searchMs
+        << ",\"build\":" << buildMs
+        << ",\"reconstruct\":" << reconstructMs
+        << ",\"encode\":" << encodeMs << "}"
+        << ",\"search_iterations\":[";
+    for (size_t i = 0; i < probes.size(); i++) {
+        out << (i ? "," : "") << "{\"threshold\":" << exactNumber(probes[i].threshold)
+            << ",\"encoded_bytes\":" << probes[i].encodedSize
+            << ",\"ms\":" << probes[i].milliseconds << "}";
+    }
+    out << "],\"peak_memory_bytes\":" << peakMemoryBytes << "}";
+    return out.str();
+}
+
+size_t RunTimer::peakMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+size_t RunTimer::physicalMemoryBytes() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? static_cast<size_t>(status.ullTotalPhys) : 0;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    return (pages > 0 && pageSize > 0) ? static_cast<size_t>(pages) * static_cast<size_t>(pageSize) : 0;
+#endif
+}
+
+QuadTree RunTimer::compress(const Image& img, int method, double threshold, int minBlockSize, double targetCompression,
+                            const string& outputExtension, int threads, RunStats& stats) {
+    stats.method = method;
+    stats.width = img.getWidth();
+    stats.height = img.getHeight();
+
+    // The summed-area tables are built once, for the search and the final tree alike
+    Clock::time_point start = Clock::now();
+    IntegralImage tables(img, IntegralImage::planesForMethod(method));
+    stats.buildMs = millisecondsSince(start);
+
+    // In target mode the search's annotated tree, cut at the threshold it picked, is the result
+    bool targetOn = (targetCompression != 0);
+    QuadTree tree(method, threshold, minBlockSize, targetOn, threads);
+    if (targetOn) {
+        start = Clock::now();
+        QuadTree searcher(method, 0, 1, targetOn, threads);
+        threshold = searcher.getBestThreshold(img, tables, stats.inputBytes, outputExtension, method,
+                                              1 - targetCompression, &stats.probes, &tree);
+        minBlockSize = 1;
+        stats.searchMs = millisecondsSince(start);
+    } else {
+        start = Clock::now();
+        tree = QuadTree(img, tables, method, threshold, minBlockSize, targetOn, threads);
+        stats.buildMs += millisecondsSince(start);
+    }
+    stats.threshold = threshold;
+    stats.minBlockSize = minBlockSize;
+    return tree;
+}
+
+bool RunTimer::save(const QuadTree& tree, const string& filename, RunStats& stats) {
+    stats.output = filename;
+    const QuadTreeNode* root = tree.getRoot();
+    if (root) {
+        stats.totalNodes = root->countTotalNodes();
+        stats.leafNodes = root->countLeafNodes();
+        stats.depth = root->depth();
+    }
+
+    bool saved;
+    string extension = Image::extensionOf(filename);
+    if (extension == "qtc" || extension == "qtt") {
+        Clock::time_point start = Clock::now();
+        saved = tree.saveImage(filename);
+        stats.encodeMs = millisecondsSince(start);
+    } else {
+        if (!root) return false;
+        Clock::time_point start = Clock::now();
+        Image decompressedImage(root->getWidth(), root->getHeight());
+        tree.decompressImage(decompressedImage);
+        stats.reconstructMs = millisecondsSince(start);
+
+        start = Clock::now();
+        saved = decompressedImage.save(filename);
+        stats.encodeMs = millisecondsSince(start);
+    }
+
+    if (saved) {
+        stats.outputBytes = outputSize(filename);
+    }
+    return saved;
+}
+
+bool RunTimer::saveRegion(const QuadTree& tree, int x, int y, int width, int height, const string& filename,
+                          RunStats& stats) {
+    stats.output = filename;
+    const QuadTreeNode* root = tree.getRoot();
+    if (!root) return false;
+    if (static_cast<long long>(x) + width > root->getWidth() || static_cast<long long>(y) + height > root->getHeight()) {
+        throw runtime_error("Region lies outside the " + to_string(root->getWidth()) + "x" +
+                            to_string(root->getHeight()) + " image");
+    }
+    stats.totalNodes = root->countTotalNodes();
+    stats.leafNodes = root->countLeafNodes();
+    stats.depth = root->depth();
+
+    Clock::time_point start = Clock::now();
+    Image crop(width, height);
+    tree.decompressRegion(crop, x, y);
+    stats.reconstructMs = millisecondsSince(start);
+
+    start = Clock::now();
+    bool saved = crop.save(filename);
+    stats.encodeMs = millisecondsSince(start);
+
+    if (saved) {
+        stats.outputBytes = outputSize(filename);
+    }
+    return saved;
+}
+
+bool RunTimer::save(const LinearQuadTree& tree, const string& filename, RunStats& stats) {
+    stats.output = filename;
+    stats.totalNodes = tree.countTotalNodes();
+    stats.leafNodes = tree.countLeafNodes();
+    stats.depth = tree.depth();
+
+    if (tree.countTotalNodes() == 0) return false;
+
+    bool saved;
+    string extension = Image::extensionOf(filename);
+    if (extension == "qtc" || extension == "qtt") {
+        Clock::time_point start = Clock::now();
+        ofstream out(filename, ios::binary);
+        saved = out && (extension == "qtc" ? tree.write(out) : tree.writeTiled(out));
+        stats.encodeMs = millisecondsSince(start);
+    } else {
+        Clock::time_point start = Clock::now();
+        Image decompressedImage(tree.getWidth(), tree.getHeight());
+        tree.fillImage(decompressedImage);
+        stats.reconstructMs = millisecondsSince(start);
+
+        start = Clock::now();
+        saved = decompressedImage.save(filename);
+        stats.encodeMs = millisecondsSince(start);
+    }
+
+    if (saved) {
+        stats.outputBytes = outputSize(filename);
+    }
+    return saved;
+}
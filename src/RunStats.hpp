@@ -0,0 +1,68 @@
+#ifndef RUNSTATS_HPP
+#define RUNSTATS_HPP
+
+#include "Image.hpp"
+#include "QuadTree.hpp"
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Everything measured while compressing one image. Phases are timed
+// separately: decode (load the input), search (target mode only, every
+// probe logged), build (the final tree), reconstruct (paint the raster,
+// raster outputs only) and encode (write the output file).
+struct RunStats {
+    string input;
+    string output;
+    bool ok = false;
+    string error;
+
+    int method = 0;
+    double threshold = 0; // the one used, found by the search in target mode
+    int minBlockSize = 1;
+    int width = 0;
+    int height = 0;
+    size_t inputBytes = 0;
+    size_t outputBytes = 0;
+    int totalNodes = 0;
+    int leafNodes = 0;
+    int depth = 0;
+
+    double decodeMs = 0;
+    double searchMs = 0;
+    double buildMs = 0;
+    double reconstructMs = 0;
+    double encodeMs = 0;
+    vector<ThresholdProbe> probes;
+    size_t peakMemoryBytes = 0; // of the whole process when the record was finished
+
+    string toJson() const; // one line, no trailing newline
+};
+
+namespace RunTimer {
+    using Clock = chrono::steady_clock;
+
+    inline double millisecondsSince(Clock::time_point start) {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    size_t peakMemoryBytes(); // peak resident set size of the process, 0 where unknown
+    size_t physicalMemoryBytes(); // installed RAM, 0 where unknown
+
+    // Searches the threshold when targetCompression is non-zero, sizing each probe as
+    // outputExtension against stats.inputBytes, then builds the tree; fills the search and build stats
+    QuadTree compress(const Image& img, int method, double threshold, int minBlockSize, double targetCompression,
+                      const string& outputExtension, int threads, RunStats& stats);
+
+    // QuadTree::saveImage with reconstruction and encoding timed apart; fills the output and tree stats
+    bool save(const QuadTree& tree, const string& filename, RunStats& stats);
+    // Paints only the width x height block at (x, y) of the tree into a raster of that size
+    bool saveRegion(const QuadTree& tree, int x, int y, int width, int height, const string& filename, RunStats& stats);
+
+    // The same for a flattened tree
+    bool save(const LinearQuadTree& tree, const string& filename, RunStats& stats);
+}
+
+#endif // RUNSTATS_HPP
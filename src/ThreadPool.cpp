@@ -0,0 +1,121 @@
+#include "ThreadPool.hpp"
+
+namespace {
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local int currentIndex = -1;
+}
+
+ThreadPool::ThreadPool(int threadCount)
+    : queued(0), pending(0), nextQueue(0), stopping(false) {
+    if (threadCount < 1) {
+        threadCount = defaultThreadCount();
+    }
+    for (int i = 0; i < threadCount; i++) {
+        queues.push_back(make_unique<WorkQueue>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(stateLock);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::defaultThreadCount() {
+    unsigned int count = thread::hardware_concurrency();
+    return count == 0 ? 1 : static_cast<int>(count);
+}
+
+int ThreadPool::workerIndex() const {
+    return currentPool == this ? currentIndex : -1;
+}
+
+void ThreadPool::submit(function<void()> task) {
+    // Workers keep their own subtasks, outside threads spread work round-robin
+    int index = workerIndex();
+    if (index < 0) {
+        index = static_cast<int>(nextQueue++ % queues.size());
+    }
+
+    pending++;
+    {
+        lock_guard<mutex> guard(stateLock);
+        queued++;
+    }
+    {
+        lock_guard<mutex> guard(queues[index]->lock);
+        queues[index]->tasks.push_back(move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+bool ThreadPool::takeTask(int index, function<void()>& task) {
+    {
+        WorkQueue& own = *queues[index];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        WorkQueue& victim = *queues[(index + offset) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        function<void()> task;
+        if (!takeTask(index, task)) {
+            unique_lock<mutex> guard(stateLock);
+            taskAvailable.wait(guard, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+            continue;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            lock_guard<mutex> guard(stateLock);
+            if (!firstError) firstError = current_exception();
+        }
+
+        if (--pending == 0) {
+            lock_guard<mutex> guard(stateLock);
+            allDone.notify_all();
+        }
+    }
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return pending == 0; });
+
+    if (firstError) {
+        exception_ptr error = firstError;
+        firstError = nullptr;
+        rethrow_exception(error);
+    }
+}
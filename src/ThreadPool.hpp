@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Work-stealing pool. Every worker has its own deque: it pushes and pops
+// its own tasks at the back (LIFO, good locality for recursive splits) and
+// steals from the front of other workers' deques when it runs dry.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(function<void()> task);
+    void wait(); // blocks until every submitted task, including nested ones, has finished
+    int size() const { return static_cast<int>(workers.size()); }
+    int workerIndex() const; // index of the calling thread in this pool, -1 for outside threads
+
+    static int defaultThreadCount();
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<thread> workers;
+    mutex stateLock;
+    condition_variable taskAvailable;
+    condition_variable allDone;
+    atomic<size_t> queued;
+    atomic<size_t> pending;
+    atomic<size_t> nextQueue;
+    bool stopping;
+    exception_ptr firstError;
+
+    void workerLoop(int index);
+    bool takeTask(int index, function<void()>& task);
+};
+
+#endif // THREADPOOL_HPP
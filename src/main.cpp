@@ -1,15 +1,434 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <cctype>
 #include <chrono>
+#include <climits>
 #include <cmath>
 #include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <vector>
 #include "Image.hpp"
 #include "QuadTree.hpp"
+#include "BatchPipeline.hpp"
+#include "ThreadPool.hpp"
+#include "RunStats.hpp"
 
 using namespace std;
 using namespace chrono;
 
-int main() {
+// Everything one run needs, filled from prompts or from command line flags
+struct Options {
+    string input;
+    string output;
+    int method = 0;
+    double threshold = 0;
+    int minBlockSize = 1;
+    double targetCompression = 0; // 0 uses threshold and minBlockSize as given
+    int threads = 1; // 0 uses every hardware thread
+
+    // Batch mode: a directory or a list file instead of a single input
+    string batchDir;
+    string listFile;
+    string outputDir;
+    string format; // output extension, empty keeps each input's own
+    int memoryMb = 0; // for images being compressed at once, 0 takes half the installed RAM
+
+    string statsFile; // JSON Lines, one record per image
+
+    int previewDepth = -1; // decoding only: stop after this many levels, -1 reads the whole tree
+    vector<int> region; // decoding only: x, y, width, height of the part to paint, empty for all of it
+
+    bool batch() const { return !batchDir.empty() || !listFile.empty(); }
+    bool decode() const { // a stored tree back to an image
+        string extension = Image::extensionOf(input);
+        return !batch() && (extension == "qtc" || extension == "qtt");
+    }
+};
+
+static void printUsage(ostream& out) {
+    out << "Usage: main [--input PATH --output PATH --method 1-5 (--threshold T [--min-block N] | --target R) [--threads N]]\n"
+        << "       main (--batch DIR | --list FILE) --output-dir DIR [--format EXT] --method 1-5 ...\n"
+        << "       main --input TREE.qtc --output PATH [--preview-depth N | --region X,Y,W,H]\n"
+        << "       main --input TREE.qtt --output PATH [--region X,Y,W,H]\n"
+        << "  --input PATH      image to compress, or a .qtc/.qtt tree to decode\n"
+        << "  --output PATH     compressed image, or .qtc/.qtt to store the tree itself\n"
+        << "  --batch DIR       compress every JPG, JPEG, PNG and BMP file in DIR\n"
+        << "  --list FILE       compress every path listed in FILE, one per line\n"
+        << "  --output-dir DIR  where batch outputs go, named after their inputs\n"
+        << "  --format EXT      batch output extension (png, jpg, bmp, qtc, qtt), default keeps the input's\n"
+        << "  --method M        1 Variance, 2 MAD, 3 Max Difference, 4 Entropy, 5 SSIM\n"
+        << "  --threshold T     error threshold, required unless --target is given\n"
+        << "  --min-block N     minimum block size (default 1)\n"
+        << "  --target R        target compression ratio in (0, 1], searches the threshold\n"
+        << "  --threads N       build threads, 0 for every hardware thread (default 1);\n"
+        << "                    in batch mode the number of images compressed at once\n"
+        << "  --memory MB       batch memory for images being compressed at once (default half the RAM);\n"
+        << "                    fewer images run together when they would not fit\n"
+        << "  --preview-depth N decode only the top N levels of a .qtc, a coarse preview read from its head\n"
+        << "  --region X,Y,W,H  decode only this rectangle of a tree into a W x H image;\n"
+        << "                    from a .qtt only the tiles it touches are read\n"
+        << "  --stats FILE      write one JSON record per image (sizes, nodes, phase timings) to FILE\n"
+        << "Without arguments the program asks for each value.\n";
+}
+
+// Whole-string conversions, so "4x" or "" are rejected instead of read as 4 or 0
+static bool parseDouble(const string& text, double& value) {
+    try {
+        size_t used = 0;
+        value = stod(text, &used);
+        return used == text.size();
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+static bool parseInt(const string& text, int& value) {
+    try {
+        size_t used = 0;
+        value = stoi(text, &used);
+        return used == text.size();
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+// X,Y,W,H with a non-negative corner and a non-empty size
+static bool parseRegion(const string& text, vector<int>& region) {
+    region.clear();
+    stringstream parts(text);
+    string part;
+    int value;
+    while (getline(parts, part, ',')) {
+        if (!parseInt(part, value)) return false;
+        region.push_back(value);
+    }
+    return region.size() == 4 && region[0] >= 0 && region[1] >= 0 && region[2] > 0 && region[3] > 0;
+}
+
+static bool isRasterExtension(const string& extension) {
+    return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp";
+}
+
+// Everything an output can be written as: an image, or the tree itself
+static bool isOutputExtension(const string& extension) {
+    return isRasterExtension(extension) || extension == "qtc" || extension == "qtt";
+}
+
+// Fills options from flags, reports the first problem in error
+static bool parseArgs(int argc, char* argv[], Options& options, string& error) {
+    bool hasThreshold = false;
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        string value;
+        size_t equals = flag.find('=');
+        if (equals != string::npos) {
+            value = flag.substr(equals + 1);
+            flag = flag.substr(0, equals);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            error = "Missing value for " + flag;
+            return false;
+        }
+
+        bool ok = true;
+        if (flag == "--input") {
+            options.input = value;
+        } else if (flag == "--output") {
+            options.output = value;
+        } else if (flag == "--method") {
+            ok = parseInt(value, options.method);
+        } else if (flag == "--threshold") {
+            ok = parseDouble(value, options.threshold);
+            hasThreshold = true;
+        } else if (flag == "--min-block") {
+            ok = parseInt(value, options.minBlockSize);
+        } else if (flag == "--target") {
+            ok = parseDouble(value, options.targetCompression);
+        } else if (flag == "--threads") {
+            ok = parseInt(value, options.threads);
+        } else if (flag == "--batch") {
+            options.batchDir = value;
+        } else if (flag == "--list") {
+            options.listFile = value;
+        } else if (flag == "--output-dir") {
+            options.outputDir = value;
+        } else if (flag == "--format") {
+            // Batch outputs are named in lowercase, so the check is too
+            options.format = value;
+            transform(options.format.begin(), options.format.end(), options.format.begin(),
+                      [](unsigned char c) { return static_cast<char>(tolower(c)); });
+            ok = isOutputExtension(options.format);
+        } else if (flag == "--memory") {
+            ok = parseInt(value, options.memoryMb);
+        } else if (flag == "--preview-depth") {
+            ok = parseInt(value, options.previewDepth) && options.previewDepth >= 0;
+        } else if (flag == "--region") {
+            ok = parseRegion(value, options.region);
+        } else if (flag == "--stats") {
+            options.statsFile = value;
+        } else {
+            error = "Unknown option " + flag;
+            return false;
+        }
+        if (!ok) {
+            error = "Invalid value for " + flag + ": " + value;
+            return false;
+        }
+    }
+
+    if (options.batch()) {
+        if (!options.batchDir.empty() && !options.listFile.empty()) {
+            error = "--batch and --list cannot be combined";
+        } else if (options.outputDir.empty()) {
+            error = "--output-dir is required in batch mode";
+        } else if (!options.input.empty() || !options.output.empty()) {
+            error = "--input and --output do not apply in batch mode";
+        }
+    } else if (options.input.empty() || options.output.empty()) {
+        error = "--input and --output are required";
+    } else if (!isOutputExtension(Image::extensionOf(options.output))) {
+        error = "--output must end in .png, .jpg, .jpeg, .bmp, .qtc or .qtt: " + options.output;
+    }
+
+    if (!error.empty()) {
+        return false;
+    } else if (options.decode()) {
+        // The tree is stored, only where to paint it is asked for
+        if (options.method != 0 || hasThreshold || options.targetCompression != 0 || options.minBlockSize != 1) {
+            error = "--method, --threshold, --min-block and --target do not apply when decoding a tree";
+        } else if (options.threads < 0) {
+            error = "--threads must be non-negative";
+        } else if (options.previewDepth >= 0 && (Image::extensionOf(options.input) != "qtc" || !options.region.empty())) {
+            error = "--preview-depth needs a .qtc input and no --region";
+        } else if (!options.region.empty() && !isRasterExtension(Image::extensionOf(options.output))) {
+            error = "--region needs an image output (png, jpg, jpeg, bmp)";
+        }
+        return error.empty();
+    } else if (options.previewDepth >= 0 || !options.region.empty()) {
+        error = "--preview-depth and --region only apply when decoding a .qtc/.qtt tree";
+    } else if (options.method < 1 || options.method > 5) {
+        error = "--method must be between 1 and 5";
+    } else if (options.targetCompression < 0 || options.targetCompression > 1) {
+        error = "--target must be between 0 and 1";
+    } else if (options.targetCompression == 0 && !hasThreshold) {
+        error = "Either --threshold or --target is required";
+    } else if (options.threshold < 0 || options.threshold > QuadTree::getMaxThresholdForMethod(options.method)) {
+        error = "--threshold must be between 0 and " + to_string(QuadTree::getMaxThresholdForMethod(options.method));
+    } else if (options.minBlockSize < 1) {
+        error = "--min-block must be at least 1";
+    } else if (options.threads < 0) {
+        error = "--threads must be non-negative";
+    } else if (options.memoryMb < 0) {
+        error = "--memory must be non-negative";
+    }
+    return error.empty();
+}
+
+// Loads the image and builds the tree the options ask for, timing each phase into stats.
+// A target ratio is measured in the format of options.output, which must be set.
+static QuadTree compress(const Options& options, RunStats& stats) {
+    stats.input = options.input;
+    stats.method = options.method;
+    stats.inputBytes = filesystem::file_size(options.input);
+
+    auto start = RunTimer::Clock::now();
+    Image img(options.input);
+    stats.decodeMs = RunTimer::millisecondsSince(start);
+
+    return RunTimer::compress(img, options.method, options.threshold, options.minBlockSize, options.targetCompression,
+                              Image::extensionOf(options.output), options.threads, stats);
+}
+
+// Saves the tree and prints the statistics, false if the output could not be written
+static bool saveAndReport(const QuadTree& quadTree, const Options& options, RunStats& stats) {
+    if (!RunTimer::save(quadTree, options.output, stats)) {
+        stats.error = "Failed to save " + options.output;
+        cerr << "Failed to save the compressed image." << endl;
+        return false;
+    }
+    stats.ok = true;
+    cout << "Compressed image saved in: " << options.output << endl;
+
+    // Display compression ratio
+    quadTree.getCompressionRatio(options.input, options.output);
+
+    cout << "Total nodes: " << stats.totalNodes << endl;
+    cout << "Depth of the QuadTree: " << stats.depth << endl;
+
+    // Load and build, as before the phases were timed apart
+    cout << "Execution time: " << static_cast<long long>(stats.decodeMs + stats.searchMs + stats.buildMs) << " ms" << endl;
+    return true;
+}
+
+// Appends nothing when no stats file was asked for
+static bool writeStats(const Options& options, const vector<RunStats>& records) {
+    if (options.statsFile.empty()) return true;
+
+    ofstream out(options.statsFile);
+    for (const RunStats& record : records) {
+        out << record.toJson() << "\n";
+    }
+    if (!out) {
+        cerr << "Error: Failed to write " << options.statsFile << endl;
+        return false;
+    }
+    return true;
+}
+
+// Batch mode: one line per image, nonzero exit if any image failed
+static int runBatch(const Options& options) {
+    try {
+        vector<BatchJob> jobs = options.batchDir.empty()
+            ? BatchPipeline::jobsFromList(options.listFile, options.outputDir, options.format)
+            : BatchPipeline::jobsFromDirectory(options.batchDir, options.outputDir, options.format);
+        filesystem::create_directories(options.outputDir);
+
+        // Building dominates, decode and encode get half as many workers
+        BatchSettings settings;
+        settings.method = options.method;
+        settings.threshold = options.threshold;
+        settings.minBlockSize = options.minBlockSize;
+        settings.targetCompression = options.targetCompression;
+        settings.compressWorkers = options.threads == 0 ? ThreadPool::defaultThreadCount() : options.threads;
+        settings.decodeWorkers = max(1, settings.compressWorkers / 2);
+        settings.encodeWorkers = max(1, settings.compressWorkers / 2);
+        settings.queueCapacity = 2 * static_cast<size_t>(settings.compressWorkers);
+        settings.memoryBudget = options.memoryMb > 0 ? static_cast<size_t>(options.memoryMb) << 20
+                                                     : RunTimer::physicalMemoryBytes() / 2;
+
+        // Each record is written as its image finishes, so a run that dies partway keeps them
+        ofstream statsOut;
+        if (!options.statsFile.empty()) {
+            statsOut.open(options.statsFile);
+            if (!statsOut) {
+                throw runtime_error("Cannot open " + options.statsFile);
+            }
+        }
+        auto writeRecord = [&statsOut](const RunStats& record) {
+            if (statsOut.is_open()) {
+                statsOut << record.toJson() << "\n" << flush;
+            }
+        };
+
+        auto start = high_resolution_clock::now();
+        vector<RunStats> results = BatchPipeline(settings).run(jobs, writeRecord);
+        auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start);
+
+        int failed = 0;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const RunStats& result = results[i];
+            if (result.ok) {
+                cout << jobs[i].input << " -> " << jobs[i].output << ": " << result.inputBytes << " -> "
+                     << result.outputBytes << " bytes, " << result.totalNodes << " nodes" << endl;
+            } else {
+                cerr << jobs[i].input << ": " << result.error << endl;
+                failed++;
+            }
+        }
+        cout << "Compressed " << jobs.size() - failed << " of " << jobs.size() << " images in " << duration.count() << " ms" << endl;
+        bool statsWritten = !statsOut.is_open() || statsOut.good();
+        if (!statsWritten) {
+            cerr << "Error: Failed to write " << options.statsFile << endl;
+        }
+        return (failed == 0 && statsWritten) ? 0 : 1;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
+
+// Decode mode: paints a stored tree, or the --region of it, into options.output,
+// which may also be another .qtc/.qtt when the whole tree is read
+static int runDecode(const Options& options) {
+    RunStats stats;
+    stats.input = options.input;
+    try {
+        stats.inputBytes = filesystem::file_size(options.input);
+        auto start = RunTimer::Clock::now();
+        // A .qtt reads only the tiles under the region, with none given every tile
+        const vector<int>& r = options.region;
+        QuadTree quadTree = Image::extensionOf(options.input) == "qtc"
+            ? QuadTree::load(options.input, options.previewDepth)
+            : r.empty() ? QuadTree::loadRegion(options.input, 0, 0, INT_MAX, INT_MAX)
+                        : QuadTree::loadRegion(options.input, r[0], r[1], r[2], r[3]);
+        stats.decodeMs = RunTimer::millisecondsSince(start);
+        stats.method = quadTree.getMethod();
+        stats.width = quadTree.getRoot()->getWidth();
+        stats.height = quadTree.getRoot()->getHeight();
+        quadTree.setThreadCount(options.threads);
+
+        bool saved = r.empty() ? RunTimer::save(quadTree, options.output, stats)
+                               : RunTimer::saveRegion(quadTree, r[0], r[1], r[2], r[3], options.output, stats);
+        if (saved) {
+            stats.ok = true;
+            cout << "Decoded image saved in: " << options.output << endl;
+            cout << "Total nodes: " << stats.totalNodes << endl;
+            cout << "Depth of the QuadTree: " << stats.depth << endl;
+            cout << "Execution time: " << static_cast<long long>(stats.decodeMs + stats.reconstructMs + stats.encodeMs) << " ms" << endl;
+        } else {
+            stats.error = "Failed to save " + options.output;
+            cerr << "Error: " << stats.error << endl;
+        }
+        stats.peakMemoryBytes = RunTimer::peakMemoryBytes();
+        bool statsWritten = writeStats(options, {stats});
+        return (saved && statsWritten) ? 0 : 1;
+    } catch (const exception& e) {
+        stats.error = e.what();
+        stats.peakMemoryBytes = RunTimer::peakMemoryBytes();
+        writeStats(options, {stats});
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
+
+// Non-interactive mode: no prompts, nonzero exit on any failure
+static int runWithFlags(int argc, char* argv[]) {
+    if (argc == 2 && (string(argv[1]) == "--help" || string(argv[1]) == "-h")) {
+        printUsage(cout);
+        return 0;
+    }
+
+    Options options;
+    string error;
+    if (!parseArgs(argc, argv, options, error)) {
+        cerr << "Error: " << error << "\n";
+        printUsage(cerr);
+        return 2;
+    }
+    if (options.batch()) {
+        return runBatch(options);
+    }
+    if (!ifstream(options.input)) {
+        cerr << "Error: File not found: " << options.input << endl;
+        return 1;
+    }
+    if (options.decode()) {
+        return runDecode(options);
+    }
+
+    RunStats stats;
+    try {
+        QuadTree quadTree = compress(options, stats);
+        bool saved = saveAndReport(quadTree, options, stats);
+        stats.peakMemoryBytes = RunTimer::peakMemoryBytes();
+        bool statsWritten = writeStats(options, {stats});
+        return (saved && statsWritten) ? 0 : 1;
+    } catch (const exception& e) {
+        stats.error = e.what();
+        stats.peakMemoryBytes = RunTimer::peakMemoryBytes();
+        writeStats(options, {stats});
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return runWithFlags(argc, argv);
+    }
 
     cout << "\n"
     << "=========================================\n"
@@ -20,7 +439,7 @@ int main() {
         string filename;
         double threshold;
         int method; 
-        int minBlockSize;
+        int minBlockSize = 1;
 
         cout << "Enter the absolute path of the image: ";
         cin >> filename;
@@ -138,57 +557,34 @@ int main() {
         }
 
 
-        // Start
-        auto start = high_resolution_clock::now();
-
-        // Load the image
-        Image img(filename);
+        Options options;
+        options.input = filename;
+        options.method = method;
+        options.threshold = targetOn ? 0 : threshold;
+        options.minBlockSize = minBlockSize;
+        options.targetCompression = targetCompression;
 
-        // Create and compress the image using QuadTree
-        QuadTree quadTree(img, method, 0, 1, targetOn); 
-        if (targetOn) { // if target compression is on
-            QuadTree quadTreeTemp(img, method, 0, 1, targetOn);
-            double bestThreshold = quadTreeTemp.getBestThreshold(filename, method, 1-targetCompression); 
-            quadTree = QuadTree(img, method, bestThreshold, 1, targetOn);
-        }
-        else {
-            quadTree = QuadTree(img, method, threshold, minBlockSize, targetOn);
-            quadTree.compressImage(img); 
-        }
-
-        // Stop
-        auto end = high_resolution_clock::now();
-        auto duration = duration_cast<milliseconds>(end - start);
-       
-        // Save the compressed image
-        string outputFilename;
+        // Asked before building: a target is searched in the output's format
         bool validPath = false;
 
         do {
             cout << "Enter the absolute path to save the compressed image: ";
-            cin >> outputFilename;
+            cin >> options.output;
 
             // Validate the path
-            if (outputFilename.empty()) {
+            if (options.output.empty()) {
             cout << "Invalid path. Please enter a valid absolute path.\n";
             } else {
             validPath = true;
             }
         } while (!validPath);
 
-        if (quadTree.saveImage(outputFilename)) {
-            cout << "Compressed image saved in: " << outputFilename << endl;
-        } else {
-            cerr << "Failed to save the compressed image." << endl;
-        }
+        RunStats stats;
+        QuadTree quadTree = compress(options, stats);
 
-        // Display compression ratio
-        quadTree.getCompressionRatio(filename, outputFilename);
-
-        cout << "Total nodes: " << quadTree.getRoot()->countTotalNodes() << endl;
-        cout << "Depth of the QuadTree: " << quadTree.getRoot()->depth() << endl;
-
-        cout << "Execution time: " << duration.count() << " ms" << endl;
+        if (!saveAndReport(quadTree, options, stats)) {
+            return 1;
+        }
 
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
@@ -0,0 +1,210 @@
+#include <climits>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/Image.hpp"
+#include "../src/QuadTree.hpp"
+#include "../src/RangeCoder.hpp"
+
+using namespace std;
+
+// Round trips through the range coder and the .qtc/.qtt readers, previews
+// read from the top levels, regions read from the tiles they touch, and the
+// readers' behaviour on damaged streams: every failure must be a runtime_error.
+namespace {
+    const char* const CORPUS[] = {"flower.jpg", "linux.png", "haein_og.png", "small.jpg"};
+    const double THRESHOLDS[5] = {500, 15, 60, 3, 0.85}; // the benchmark's medium column
+
+    int failures = 0;
+
+    void check(bool ok, const string& what) {
+        cout << (ok ? "PASS  " : "FAIL  ") << what << endl;
+        if (!ok) failures++;
+    }
+
+    bool samePixels(const Image& a, const Image& b) {
+        if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) return false;
+        for (int y = 0; y < a.getHeight(); y++) {
+            for (int x = 0; x < a.getWidth(); x++) {
+                for (int c = 0; c < 3; c++) {
+                    if (a.getPixel(x, y, c) != b.getPixel(x, y, c)) return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    Image paint(const QuadTree& tree) {
+        Image img(tree.getRoot()->getWidth(), tree.getRoot()->getHeight());
+        tree.decompressImage(img);
+        return img;
+    }
+
+    int nodesDownTo(const QuadTreeNode* node, int depth) {
+        if (node->isLeafNode() || depth == 0) return 1;
+        int count = 1;
+        for (int k = 0; k < 4; k++) count += nodesDownTo(node->getChild(k), depth - 1);
+        return count;
+    }
+
+    // A preview holds exactly the top levels of the tree, and a deep enough one is the tree
+    void previews(const QuadTree& tree, const string& data, const string& name) {
+        int depth = tree.getRoot()->depth();
+        bool ok = true;
+        for (int maxDepth = 0; maxDepth <= depth + 1; maxDepth++) {
+            istringstream in(data);
+            QuadTree preview = QuadTree::read(in, maxDepth);
+            ok = ok && preview.getRoot()->countTotalNodes() == nodesDownTo(tree.getRoot(), maxDepth) &&
+                 preview.allocatedNodes() == static_cast<size_t>(preview.getRoot()->countTotalNodes()) &&
+                 preview.getRoot()->depth() == min(maxDepth, depth) &&
+                 static_cast<size_t>(in.tellg()) == data.size(); // the stream is left after the tree
+        }
+        istringstream in(data);
+        ok = ok && samePixels(paint(tree), paint(QuadTree::read(in, depth)));
+        check(ok, name + ": previews at every depth hold the top levels of the tree");
+    }
+
+    // Each region read from a .qtt paints what the whole tree paints there, from fewer nodes
+    void regions(const QuadTree& tree, const string& name) {
+        ostringstream out;
+        tree.writeTiled(out);
+        int width = tree.getRoot()->getWidth(), height = tree.getRoot()->getHeight();
+        const int boxes[][4] = {{0, 0, width, height}, {0, 0, 1, 1}, {width - 1, height - 1, 1, 1},
+                                {width / 3, height / 4, width / 5, height / 6}, {0, height / 2, width, 7}};
+
+        bool ok = true, partial = true;
+        for (const auto& box : boxes) {
+            istringstream in(out.str());
+            QuadTree region = QuadTree::readRegion(in, box[0], box[1], box[2], box[3]);
+            Image expected(box[2], box[3]), actual(box[2], box[3]);
+            tree.decompressRegion(expected, box[0], box[1]);
+            region.decompressRegion(actual, box[0], box[1]);
+            ok = ok && samePixels(expected, actual);
+            if (box[2] * box[3] < width * height / 4) {
+                partial = partial && region.getRoot()->countTotalNodes() < tree.getRoot()->countTotalNodes();
+            }
+        }
+        check(ok, name + ": regions read from .qtt paint the same pixels as the whole tree");
+        check(partial, name + ": small regions decode only part of the tree");
+    }
+
+    void rangeCoderRoundTrip() {
+        mt19937 random(1);
+        vector<int> bits, bytes;
+        vector<unsigned char> data;
+        {
+            RangeEncoder rc(data);
+            BitModel skewed, even;
+            ByteModel symbols;
+            for (int i = 0; i < 100000; i++) {
+                bits.push_back(random() % 10 == 0);
+                skewed.encode(rc, bits.back());
+                bits.push_back(random() % 2);
+                even.encode(rc, bits.back());
+                bytes.push_back(random() % 256);
+                symbols.encode(rc, bytes.back());
+            }
+            rc.finish();
+        }
+
+        RangeDecoder rc(data.data(), data.size());
+        BitModel skewed, even;
+        ByteModel symbols;
+        bool same = true;
+        for (size_t i = 0; i < bytes.size(); i++) {
+            same = same && skewed.decode(rc) == bits[2 * i] && even.decode(rc) == bits[2 * i + 1] &&
+                   symbols.decode(rc) == bytes[i];
+        }
+        check(same, "range coder: 200000 bits and 100000 bytes decode as coded");
+    }
+
+    // Reading must either succeed or throw runtime_error, never anything else
+    bool failsCleanly(const string& data, bool tiled, bool& threw) {
+        threw = false;
+        try {
+            istringstream in(data);
+            if (tiled) QuadTree::readRegion(in, 0, 0, INT_MAX, INT_MAX);
+            else QuadTree::read(in);
+        } catch (const runtime_error&) {
+            threw = true;
+        } catch (const exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    void damagedStreams(const string& data, bool tiled, const string& name) {
+        bool clean = true, allThrew = true, threw;
+        for (size_t length = 0; length < data.size(); length++) {
+            clean = clean && failsCleanly(data.substr(0, length), tiled, threw);
+            allThrew = allThrew && threw;
+        }
+        check(clean && allThrew, name + ": every truncation throws runtime_error");
+
+        mt19937 random(2);
+        clean = true;
+        for (int trial = 0; trial < 2000; trial++) {
+            string damaged = data;
+            for (int flips = 1 + trial % 4; flips > 0; flips--) {
+                damaged[random() % damaged.size()] ^= static_cast<char>(1 << (random() % 8));
+            }
+            clean = clean && failsCleanly(damaged, tiled, threw);
+        }
+        check(clean, name + ": 2000 streams with flipped bits decode or throw runtime_error");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string corpus = argc > 1 ? argv[1] : "test";
+    try {
+        rangeCoderRoundTrip();
+
+        for (const char* name : CORPUS) {
+            Image img((filesystem::path(corpus) / name).string());
+            for (int method = 1; method <= 5; method++) {
+                QuadTree tree(method, THRESHOLDS[method - 1], 1, false);
+                tree.compressImage(img);
+                ostringstream out;
+                tree.write(out);
+
+                istringstream in(out.str());
+                QuadTree decoded = QuadTree::read(in);
+                check(decoded.getRoot()->countTotalNodes() == tree.getRoot()->countTotalNodes() &&
+                          decoded.getMethod() == method && samePixels(paint(tree), paint(decoded)),
+                      string(name) + " method " + to_string(method) + ": .qtc decodes to the same tree");
+            }
+        }
+
+        // A coarse tree keeps the stream short enough to cut at every byte
+        Image flower((filesystem::path(corpus) / "flower.jpg").string());
+        QuadTree tree(1, 2000, 4, false);
+        tree.compressImage(flower);
+        ostringstream out;
+        tree.write(out);
+        damagedStreams(out.str(), false, "flower.jpg .qtc");
+        ostringstream tiledOut;
+        tree.writeTiled(tiledOut);
+        damagedStreams(tiledOut.str(), true, "flower.jpg .qtt");
+
+        QuadTree fine(1, 50, 1, false);
+        fine.compressImage(flower);
+        ostringstream fineOut;
+        fine.write(fineOut);
+        previews(fine, fineOut.str(), "flower.jpg .qtc");
+        regions(fine, "flower.jpg");
+
+        Image haein((filesystem::path(corpus) / "haein_og.png").string());
+        QuadTree photo(5, 0.85, 1, false);
+        photo.compressImage(haein);
+        regions(photo, "haein_og.png");
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    cout << (failures == 0 ? "All checks passed" : to_string(failures) + " checks failed") << endl;
+    return failures == 0 ? 0 : 1;
+}